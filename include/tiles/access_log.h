@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/core.h"
+
+#include "geo/tile.h"
+
+#include "utl/verify.h"
+
+#include "blockingconcurrentqueue.h"
+
+namespace tiles {
+
+struct access_log_entry {
+  enum class source : uint8_t {
+    NONE,
+    PREPARED,
+    CACHE,
+    RENDER,
+    NOT_MODIFIED,
+    OVERZOOM
+  };
+
+  int64_t timestamp_ns_{0};  // system_clock, set by access_log::push
+  geo::tile tile_{};
+  uint16_t status_{0};
+  uint64_t bytes_{0};
+  uint64_t duration_ns_{0};  // until the response was ready
+  uint64_t render_ns_{0};  // render time if rendered (also when coalesced)
+  source source_{source::NONE};
+};
+
+// Access log which never blocks request handling.
+//
+// push neither formats nor locks: the entry is put into a preallocated
+// lock-free queue (dropped if full) and a background thread formats and
+// writes batches of lines. Successful responses can be sampled
+// (every n-th is logged); errors are always logged (unless the queue is full).
+//
+// Lines are logfmt, e.g.:
+// 2020-01-01T12:00:00.123Z tile=10/511/340 status=200 bytes=1234
+//     duration_us=15 render_us=0 source=cache
+struct access_log {
+  access_log(std::string const& fname, size_t const capacity,
+             uint32_t const sample_every)
+      : sample_every_{std::max(sample_every, 1U)}, queue_{capacity} {
+    if (fname == "-") {
+      out_ = &std::clog;
+    } else {
+      file_ = std::make_unique<std::ofstream>(fname, std::ios_base::app);
+      utl::verify(file_->good(), "cannot open access log: {}", fname);
+      out_ = file_.get();
+    }
+    flusher_ = std::thread{[this] { run(); }};
+  }
+
+  ~access_log() {
+    stop_ = true;
+    flusher_.join();
+  }
+
+  access_log(access_log const&) = delete;
+  access_log(access_log&&) = delete;
+  access_log& operator=(access_log const&) = delete;
+  access_log& operator=(access_log&&) = delete;
+
+  void push(access_log_entry entry) {
+    if (entry.status_ < 400 && sample_every_ != 1) {
+      thread_local uint32_t counter = 0;
+      if (++counter % sample_every_ != 0) {
+        return;
+      }
+    }
+
+    entry.timestamp_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now()  //
+                                  .time_since_epoch())
+                              .count();
+    if (!queue_.try_enqueue(entry)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  static char const* to_str(access_log_entry::source const s) {
+    switch (s) {
+      case access_log_entry::source::PREPARED: return "prepared";
+      case access_log_entry::source::CACHE: return "cache";
+      case access_log_entry::source::RENDER: return "render";
+      case access_log_entry::source::NOT_MODIFIED: return "not_modified";
+      case access_log_entry::source::OVERZOOM: return "overzoom";
+      default: return "none";
+    }
+  }
+
+  static void format(std::string& out, access_log_entry const& e) {
+    auto const secs = static_cast<std::time_t>(e.timestamp_ns_ / 1000000000);
+    auto const millis = (e.timestamp_ns_ / 1000000) % 1000;
+    struct tm tmp {};
+#if _MSC_VER >= 1400
+    gmtime_s(&tmp, &secs);
+#else
+    gmtime_r(&secs, &tmp);
+#endif
+    char time_str[32];
+    std::strftime(time_str, sizeof(time_str), "%FT%T", &tmp);
+
+    out += fmt::format(
+        "{}.{:03}Z tile={}/{}/{} status={} bytes={} duration_us={} "
+        "render_us={} source={}\n",
+        time_str, millis, e.tile_.z_, e.tile_.x_, e.tile_.y_, e.status_,
+        e.bytes_, e.duration_ns_ / 1000, e.render_ns_ / 1000,
+        to_str(e.source_));
+  }
+
+  void run() {
+    std::vector<access_log_entry> batch(1024);
+    std::string buf;
+    uint64_t reported_dropped = 0;
+
+    while (true) {
+      auto const stopping = stop_.load();  // drain once more after stop
+
+      auto const n = queue_.wait_dequeue_bulk_timed(
+          begin(batch), batch.size(), std::chrono::milliseconds{100});
+      for (auto i = 0ULL; i < n; ++i) {
+        format(buf, batch[i]);
+      }
+
+      if (auto const d = dropped(); d != reported_dropped) {
+        buf += fmt::format("access log: dropped {} entries\n",
+                           d - reported_dropped);
+        reported_dropped = d;
+      }
+
+      if (!buf.empty()) {
+        out_->write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        out_->flush();
+        buf.clear();
+      }
+
+      if (stopping && n == 0) {
+        break;
+      }
+    }
+  }
+
+  uint32_t sample_every_;
+  moodycamel::BlockingConcurrentQueue<access_log_entry> queue_;
+  std::atomic_uint64_t dropped_{0};
+  std::atomic_bool stop_{false};
+
+  std::unique_ptr<std::ofstream> file_;
+  std::ostream* out_{nullptr};
+  std::thread flusher_;
+};
+
+}  // namespace tiles
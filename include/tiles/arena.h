@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "utl/verify.h"
+
+namespace tiles {
+
+// Monotonic arena for the short lived containers of one render: allocations
+// are bumped from blocks and only released as a whole with the arena.
+//
+// Blocks of the default size are recycled through a (bounded) thread local
+// pool: renders on the same thread reuse the memory of their predecessors.
+struct arena {
+  static constexpr size_t kBlockSize = 64ULL * 1024ULL;
+  static constexpr size_t kMaxPooledBlocks = 64;  // per thread
+
+  using block_t = std::unique_ptr<char[]>;
+
+  arena() = default;
+  ~arena() {
+    auto& pool = block_pool();
+    for (auto& block : blocks_) {
+      if (pool.size() < kMaxPooledBlocks) {
+        pool.emplace_back(std::move(block));
+      }
+    }
+  }
+
+  arena(arena const&) = delete;
+  arena(arena&&) = delete;
+  arena& operator=(arena const&) = delete;
+  arena& operator=(arena&&) = delete;
+
+  void* allocate(size_t const size, size_t const alignment) {
+    if (ptr_ != nullptr) {
+      auto const aligned = align(ptr_, alignment);
+      if (aligned <= end_ && static_cast<size_t>(end_ - aligned) >= size) {
+        ptr_ = aligned + size;
+        return aligned;
+      }
+    }
+
+    if (size + alignment > kBlockSize / 4) {  // own block, not pooled
+      large_blocks_.emplace_back(new char[size + alignment]);
+      return align(large_blocks_.back().get(), alignment);
+    }
+
+    blocks_.emplace_back(next_block());
+    ptr_ = align(blocks_.back().get(), alignment) + size;
+    end_ = blocks_.back().get() + kBlockSize;
+    return ptr_ - size;
+  }
+
+  std::string_view copy(std::string_view const str) {
+    if (str.empty()) {
+      return {};
+    }
+    auto const data = static_cast<char*>(allocate(str.size(), 1));
+    std::memcpy(data, str.data(), str.size());
+    return {data, str.size()};
+  }
+
+  size_t block_count() const { return blocks_.size() + large_blocks_.size(); }
+
+private:
+  static char* align(char* ptr, size_t const alignment) {
+    auto const addr = reinterpret_cast<std::uintptr_t>(ptr);
+    return ptr + ((alignment - addr % alignment) % alignment);
+  }
+
+  static std::vector<block_t>& block_pool() {
+    static thread_local std::vector<block_t> pool;
+    return pool;
+  }
+
+  static block_t next_block() {
+    auto& pool = block_pool();
+    if (pool.empty()) {
+      return block_t{new char[kBlockSize]};
+    }
+    auto block = std::move(pool.back());
+    pool.pop_back();
+    return block;
+  }
+
+  std::vector<block_t> blocks_, large_blocks_;
+  char* ptr_{nullptr};
+  char* end_{nullptr};
+};
+
+// std allocator on top of an arena (deallocate is a no-op)
+template <typename T>
+struct arena_allocator {
+  using value_type = T;
+
+  explicit arena_allocator(arena& a) : arena_{&a} {}
+
+  template <typename U>
+  arena_allocator(arena_allocator<U> const& other)  // NOLINT
+      : arena_{other.arena_} {}
+
+  T* allocate(size_t const n) {
+    utl::verify(n <= std::numeric_limits<size_t>::max() / sizeof(T),
+                "arena_allocator: too large");
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) {}
+
+  template <typename U>
+  friend bool operator==(arena_allocator const& lhs,
+                         arena_allocator<U> const& rhs) {
+    return lhs.arena_ == rhs.arena_;
+  }
+
+  template <typename U>
+  friend bool operator!=(arena_allocator const& lhs,
+                         arena_allocator<U> const& rhs) {
+    return lhs.arena_ != rhs.arena_;
+  }
+
+  arena* arena_;
+};
+
+}  // namespace tiles
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace tiles {
+
+// Cooperative cancellation, e.g. of a render whose client is gone.
+//
+// cancel() may be called from any thread. Long running code polls
+// cancelled() (a relaxed load) or calls throw_if_cancelled at safe points.
+struct cancel_token {
+  void cancel() {
+    std::vector<std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> l{mutex_};
+      if (cancelled_) {
+        return;
+      }
+      cancelled_ = true;
+      callbacks = std::move(callbacks_);
+    }
+
+    for (auto const& callback : callbacks) {
+      callback();
+    }
+  }
+
+  bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+  // fn is called once on cancel (immediately if already cancelled)
+  void on_cancel(std::function<void()> fn) {
+    {
+      std::lock_guard<std::mutex> l{mutex_};
+      if (!cancelled_) {
+        callbacks_.emplace_back(std::move(fn));
+        return;
+      }
+    }
+    fn();
+  }
+
+  std::mutex mutex_;
+  std::atomic_bool cancelled_{false};
+  std::vector<std::function<void()>> callbacks_;
+};
+
+using cancel_token_ptr = std::shared_ptr<cancel_token>;
+
+struct render_cancelled : public std::exception {
+  char const* what() const noexcept override { return "render cancelled"; }
+};
+
+inline cancel_token const& never_cancelled() {
+  static cancel_token const token;
+  return token;
+}
+
+inline void throw_if_cancelled(cancel_token const& token) {
+  if (token.cancelled()) {
+    throw render_cancelled{};
+  }
+}
+
+// Work shared by several callers: token_ is cancelled once all members are.
+// Members added after that do not revive it.
+struct cancel_group : public std::enable_shared_from_this<cancel_group> {
+  // nullptr: member which never cancels
+  void add(cancel_token* member) {
+    members_.fetch_add(1);
+    if (member == nullptr) {
+      return;
+    }
+    member->on_cancel([self = shared_from_this()] {
+      if (self->members_.fetch_sub(1) == 1) {
+        self->token_.cancel();
+      }
+    });
+  }
+
+  cancel_token token_;
+  std::atomic_size_t members_{0};
+};
+
+}  // namespace tiles
@@ -1,10 +1,20 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
+#include "lmdb/lmdb.hpp"
+
 namespace tiles {
 
 struct tile_db_handle;
 struct pack_handle;
 
+// sizes of the prepared tiles per zoom level [0, max_prepared_zoom_level]
+// other records of the tiles dbi (e.g. etags) are skipped
+std::vector<std::vector<size_t>> prepared_tile_sizes(
+    lmdb::txn&, lmdb::txn::dbi&, uint32_t max_prepared_zoom_level);
+
 void database_stats(tile_db_handle&, pack_handle&);
 
 }  // namespace tiles
@@ -2,6 +2,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "protozero/varint.hpp"
@@ -158,38 +159,66 @@ size_t unpack_features(std::string_view const& string, Fn&& fn) {
   return std::distance(string.data(), ptr);
 }
 
+// features of the span (null terminated) at the begin of string
+// returns the size of the span (incl. terminator)
 template <typename Fn>
-void unpack_features(geo::tile const& root, std::string_view const& string,
-                     geo::tile const& tile, Fn&& fn) {
+size_t unpack_span(std::string_view const& string, Fn&& fn) {
+  auto const* ptr = string.data();
+  auto const* const end = string.data() + string.size();
+  size_t size = 0;
+  while ((size = protozero::decode_varint(&ptr, end)) != 0) {
+    fn(std::string_view{ptr, size});
+    ptr += size;
+  }
+  return std::distance(string.data(), ptr);
+}
+
+// spatial query with tile, but features up to zoom level max_z (metatiles)
+// yields the matching spans: fn(string from span begin) -> span size
+// returns false if there is no quad tree (nothing yielded)
+template <typename Fn>
+bool unpack_spans(geo::tile const& root, std::string_view const& string,
+                  geo::tile const& tile, uint32_t const max_z, Fn&& fn) {
   utl::verify(string.size() >= 5, "unpack_features: invalid feature_pack");
   auto const idx_offset = find_segment_offset(string, kQuadTreeFeatureIndexId);
   if (!idx_offset) {
-    unpack_features(string, fn);  // no quad tree available, fallback
-    return;
+    return false;
   }
 
   utl::verify(string.size() >= *idx_offset, "invalid feature_pack idx_offset");
   auto const* idx_ptr = string.data() + *idx_offset;
   auto const* const end = string.data() + string.size();
-  for (auto z = root.z_; z <= std::max(root.z_, tile.z_); ++z) {
+  for (auto z = root.z_; z <= std::max(root.z_, max_z); ++z) {
     auto const tree_offset = protozero::decode_varint(&idx_ptr, end);
     if (tree_offset == 0) {
       continue;  // index empty
     }
 
-    walk_quad_tree(
-        string.data() + tree_offset, root, tile,
-        [&](auto const span_offset, auto const span_count) {
-          auto span_ptr = string.data() + span_offset;
-          for (auto i = 0ULL; i < span_count; ++i) {
-            size_t size = 0;
-            while ((size = protozero::decode_varint(&span_ptr, end)) != 0) {
-              fn(std::string_view{span_ptr, size});
-              span_ptr += size;
-            }
-          }
-        });
+    walk_quad_tree(string.data() + tree_offset, root, tile,
+                   [&](auto const span_offset, auto const span_count) {
+                     auto offset = static_cast<size_t>(span_offset);
+                     for (auto i = 0ULL; i < span_count; ++i) {
+                       offset += fn(string.substr(offset));
+                     }
+                   });
   }
+  return true;
+}
+
+template <typename Fn>
+void unpack_features(geo::tile const& root, std::string_view const& string,
+                     geo::tile const& tile, uint32_t const max_z, Fn&& fn) {
+  if (!unpack_spans(root, string, tile, max_z, [&](auto const& span) {
+        return unpack_span(span, fn);
+      })) {
+    unpack_features(string, fn);  // no quad tree available, fallback
+  }
+}
+
+template <typename Fn>
+void unpack_features(geo::tile const& root, std::string_view const& string,
+                     geo::tile const& tile, Fn&& fn) {
+  unpack_features(root, string, tile, tile.z_, std::forward<Fn>(fn));
 }
 
 struct tile_db_handle;
@@ -7,6 +7,8 @@ namespace tiles {
 struct tile_db_handle;
 struct pack_handle;
 
-void prepare_tiles(tile_db_handle&, pack_handle&, uint32_t max_zoomlevel);
+// metatile_levels > 0: render 2^n x 2^n tiles at once (see get_metatile)
+void prepare_tiles(tile_db_handle&, pack_handle&, uint32_t max_zoomlevel,
+                   uint32_t metatile_levels = 0);
 
 }  // namespace tiles
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "lmdb/lmdb.hpp"
+
+#include "utl/verify.h"
+
+#include "tiles/db/tile_database.h"
+
+namespace tiles {
+
+// Read-only transaction with dbi handles and a cursor on the features dbi.
+//
+// Reset while idle in the pool (no snapshot pinned, the reader slot is kept)
+// and renewed to the latest snapshot when acquired again.
+struct read_txn {
+  read_txn(lmdb::env& env, MDB_dbi const tiles_dbi, MDB_dbi const features_dbi)
+      : txn_{env, lmdb::txn_flags::RDONLY},
+        tiles_dbi_{txn_.txn_, tiles_dbi},
+        features_dbi_{txn_.txn_, features_dbi} {
+    cursor_.emplace(txn_, features_dbi_);
+  }
+
+  // releases the snapshot, renew before the next use
+  void reset() {
+    cursor_.reset();
+    mdb_txn_reset(txn_.txn_);
+  }
+
+  void renew() {
+    auto const rc = mdb_txn_renew(txn_.txn_);
+    utl::verify(rc == MDB_SUCCESS, "mdb_txn_renew failed: {}",
+                mdb_strerror(rc));
+    cursor_.emplace(txn_, features_dbi_);
+  }
+
+  lmdb::txn& txn() { return txn_; }
+  lmdb::cursor& features_cursor() { return *cursor_; }
+  lmdb::txn::dbi& tiles_dbi() { return tiles_dbi_; }
+  lmdb::txn::dbi& features_dbi() { return features_dbi_; }
+
+  lmdb::txn txn_;
+  lmdb::txn::dbi tiles_dbi_, features_dbi_;  // MDB_txn* stays the same
+  std::optional<lmdb::cursor> cursor_;
+};
+
+// Pool of read_txn for request handling: acquire hands out an idle (renewed)
+// transaction, it is reset and returned when the last reference is gone.
+//
+// Responses may pin a transaction (its snapshot and reader slot) until they
+// are written: try_pin allows at most max_pinned of them, slow clients must
+// not use up the reader slots of the environment (MDB_READERS_FULL).
+//
+// Transactions move between threads: the environment must be opened with
+// lmdb::env_open_flags::NOTLS. The pool must outlive all acquired references.
+struct read_txn_pool {
+  explicit read_txn_pool(tile_db_handle& handle,
+                         size_t const max_pinned =
+                             std::numeric_limits<size_t>::max())
+      : env_{handle.env_}, max_pinned_{max_pinned} {
+    // mdb_dbi_open must not run concurrently: the handles are opened once
+    // here and shared by all transactions of the environment
+    std::lock_guard<std::mutex> l{mutex_};
+    lmdb::txn txn{env_, lmdb::txn_flags::RDONLY};
+    tiles_dbi_ = handle.tiles_dbi(txn).dbi_;
+    features_dbi_ = handle.features_dbi(txn).dbi_;
+    txn.commit();  // handles of aborted transactions are closed
+  }
+
+  std::shared_ptr<read_txn> acquire() {
+    std::unique_ptr<read_txn> txn;
+    {
+      std::lock_guard<std::mutex> l{mutex_};
+      if (!idle_.empty()) {
+        txn = std::move(idle_.back());
+        idle_.pop_back();
+      }
+    }
+
+    if (txn == nullptr) {
+      txn = std::make_unique<read_txn>(env_, tiles_dbi_, features_dbi_);
+    } else {
+      txn->renew();
+    }
+
+    return {txn.release(), [this](read_txn* ptr) {
+              ptr->reset();
+              std::lock_guard<std::mutex> l{mutex_};
+              idle_.emplace_back(ptr);
+            }};
+  }
+
+  // lease: e.g. from acquire, kept until the returned pin is released
+  // nullptr: max_pinned reached, copy the data instead
+  std::shared_ptr<void const> try_pin(std::shared_ptr<void const> lease) {
+    if (pinned_.fetch_add(1) >= max_pinned_) {
+      --pinned_;
+      return nullptr;
+    }
+
+    struct pin {
+      pin(std::shared_ptr<void const> lease, std::atomic_size_t& pinned)
+          : lease_{std::move(lease)}, pinned_{pinned} {}
+      ~pin() { --pinned_; }
+
+      pin(pin const&) = delete;
+      pin(pin&&) = delete;
+      pin& operator=(pin const&) = delete;
+      pin& operator=(pin&&) = delete;
+
+      std::shared_ptr<void const> lease_;
+      std::atomic_size_t& pinned_;
+    };
+    return std::make_shared<pin const>(std::move(lease), pinned_);
+  }
+
+  size_t pinned() const { return pinned_; }
+
+  lmdb::env& env_;
+  MDB_dbi tiles_dbi_{0}, features_dbi_{0};
+
+  size_t max_pinned_;
+  std::atomic_size_t pinned_{0};
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<read_txn>> idle_;
+};
+
+}  // namespace tiles
@@ -20,16 +20,19 @@ constexpr auto kMetaKeyMaxPreparedZoomLevel = "max-prepared-zoomlevel";
 constexpr auto kMetaKeyFullySeasideTree = "fully-seaside-tree";
 constexpr auto kMetaKeyLayerNames = "layer-names";
 constexpr auto kMetaKeyFeatureMetaCoding = "feature-meta-coding";
+constexpr auto kMetaKeyGeneration = "generation";
 
 using dbi_opener_fn =
     std::function<lmdb::txn::dbi(lmdb::txn&, lmdb::dbi_flags)>;
 
 inline lmdb::env make_tile_database(
     char const* db_fname, size_t const db_size,
-    lmdb::env_open_flags flags = lmdb::env_open_flags::NOSUBDIR) {
+    lmdb::env_open_flags flags = lmdb::env_open_flags::NOSUBDIR,
+    unsigned const max_readers = 126) {
   lmdb::env e;
   e.set_mapsize(db_size);
   e.set_maxdbs(8);
+  e.set_maxreaders(max_readers);
   try {
     e.open(db_fname, flags);
   } catch (...) {
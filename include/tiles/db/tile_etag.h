@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "lmdb/lmdb.hpp"
+
+#include "tiles/bin_utils.h"
+#include "tiles/db/tile_database.h"
+#include "tiles/db/tile_index.h"
+
+namespace tiles {
+
+// Validators for HTTP caching.
+//
+// Prepared tiles: prepare_tiles stores a content hash next to each blob in
+// the tiles dbi (key tile_to_key(tile, kTileKeyNEtag), value uint64_t).
+// Databases without stored hashes: hash of the blob.
+//
+// Rendered tiles: hash of the database generation and the raw feature index
+// entries (= pack records) the tile would be rendered from. Cheap to compute
+// without rendering and changes whenever the database is rebuilt.
+constexpr tile_key_t kTileKeyNEtag = 1;
+
+constexpr uint64_t kEtagHashSeed = 14695981039346656037ULL;
+
+// FNV-1a 64
+inline uint64_t etag_hash(std::string_view const data,
+                          uint64_t hash = kEtagHashSeed) {
+  for (auto const c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t etag_hash_value(T const& t, uint64_t const hash) {
+  return etag_hash({reinterpret_cast<char const*>(&t), sizeof(T)}, hash);
+}
+
+inline void put_prepared_etag(lmdb::txn& txn, lmdb::txn::dbi& tiles_dbi,
+                              geo::tile const& tile, std::string_view data) {
+  std::string buf;
+  append(buf, etag_hash(data));
+  txn.put(tiles_dbi, tile_to_key(tile, kTileKeyNEtag), buf);
+}
+
+// nullopt: no prepared tile (not rendered or rendered seaside only)
+inline std::optional<uint64_t> get_prepared_etag(lmdb::txn& txn,
+                                                 lmdb::txn::dbi& tiles_dbi,
+                                                 geo::tile const& tile) {
+  auto const val = txn.get(tiles_dbi, tile_to_key(tile, kTileKeyNEtag));
+  if (val && val->size() == sizeof(uint64_t)) {
+    return read<uint64_t>(val->data());
+  }
+
+  auto const data = txn.get(tiles_dbi, tile_to_key(tile));
+  if (!data) {
+    return std::nullopt;
+  }
+  return etag_hash(*data);
+}
+
+// tiles which only depend on the database generation (e.g. seaside tiles)
+inline uint64_t get_generation_etag(geo::tile const& tile,
+                                    uint64_t const generation) {
+  return etag_hash_value(tile_to_key(tile),
+                         etag_hash_value(generation, kEtagHashSeed));
+}
+
+inline uint64_t get_dynamic_etag(lmdb::cursor& features_cursor,
+                                 geo::tile const& tile,
+                                 uint64_t const generation) {
+  auto hash = get_generation_etag(tile, generation);
+
+  // same iteration as pack_records_foreach, but on the raw records
+  auto const bounds = tile.bounds_on_z(kTileDefaultIndexZoomLvl);
+  for (auto y = bounds.miny_; y < bounds.maxy_; ++y) {
+    auto const key_begin =
+        tile_to_key(bounds.minx_, y, kTileDefaultIndexZoomLvl);
+    auto const key_end = tile_to_key(bounds.maxx_, y, kTileDefaultIndexZoomLvl);
+
+    for (auto el = features_cursor.get(lmdb::cursor_op::SET_RANGE, key_begin);
+         el && el->first < key_end;
+         el = features_cursor.get<decltype(key_begin)>(lmdb::cursor_op::NEXT)) {
+      hash = etag_hash_value(el->first, hash);
+      hash = etag_hash(el->second, hash);
+    }
+  }
+  return hash;
+}
+
+inline void put_database_generation(tile_db_handle& handle, lmdb::txn& txn) {
+  std::random_device rd;
+  auto const generation =
+      etag_hash_value(rd(), etag_hash_value(std::chrono::system_clock::now()
+                                                .time_since_epoch()
+                                                .count(),
+                                            kEtagHashSeed));
+  auto meta_dbi = handle.meta_dbi(txn);
+  txn.put(meta_dbi, kMetaKeyGeneration, std::to_string(generation));
+}
+
+// databases without generation: derived from the features dbi layout
+inline uint64_t get_database_generation(tile_db_handle& handle,
+                                        lmdb::txn& txn) {
+  auto meta_dbi = handle.meta_dbi(txn);
+  if (auto const val = txn.get(meta_dbi, kMetaKeyGeneration); val) {
+    return std::stoull(std::string{*val});
+  }
+
+  auto const stat = handle.features_dbi(txn).stat();
+  auto hash = kEtagHashSeed;
+  for (auto const v : {static_cast<uint64_t>(stat.ms_depth),
+                       static_cast<uint64_t>(stat.ms_branch_pages),
+                       static_cast<uint64_t>(stat.ms_leaf_pages),
+                       static_cast<uint64_t>(stat.ms_overflow_pages),
+                       static_cast<uint64_t>(stat.ms_entries)}) {
+    hash = etag_hash_value(v, hash);
+  }
+  return hash;
+}
+
+// If-None-Match uses the weak comparison: "W/" prefixes are ignored.
+inline bool etag_matches(std::string_view if_none_match,
+                         std::string_view const etag) {
+  auto const strip_weak = [](std::string_view sv) {
+    return sv.substr(0, 2) == "W/" ? sv.substr(2) : sv;
+  };
+
+  auto const target = strip_weak(etag);
+  while (!if_none_match.empty()) {
+    auto const comma = if_none_match.find(',');
+    auto item = if_none_match.substr(0, comma);
+    if_none_match.remove_prefix(
+        comma == std::string_view::npos ? if_none_match.size() : comma + 1);
+
+    while (!item.empty() && item.front() == ' ') {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && item.back() == ' ') {
+      item.remove_suffix(1);
+    }
+
+    if (item == "*" || strip_weak(item) == target) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace tiles
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+
+#include "geo/tile.h"
+#include "lmdb/lmdb.hpp"
+
+#include "tiles/db/pack_file.h"
+#include "tiles/db/tile_index.h"
+
+namespace tiles {
+
+// Warm-up after a (re)start: pre-fault the pages of the database map and the
+// pack file which are needed first, before the load balancer routes traffic.
+
+constexpr auto const kWarmUpPageSize = 4096ULL;
+
+// Faults in all pages of a memory mapped range. The kernel is asked to read
+// ahead (MADV_WILLNEED) first, then one byte per page is read: afterwards the
+// range is resident (for now). The reads are volatile, they must not be
+// optimized away even if the returned checksum is ignored.
+inline uint8_t prefetch(std::string_view const data) {
+  if (data.empty()) {
+    return 0;
+  }
+
+#ifndef _MSC_VER
+  auto const begin = reinterpret_cast<std::uintptr_t>(data.data()) &
+                     ~(kWarmUpPageSize - 1);
+  auto const end = reinterpret_cast<std::uintptr_t>(data.data()) + data.size();
+  // NOLINTNEXTLINE(performance-no-int-to-ptr)
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+#endif
+
+  auto const* bytes = reinterpret_cast<uint8_t const volatile*>(data.data());
+  uint8_t sum = 0;
+  for (auto i = 0ULL; i < data.size(); i += kWarmUpPageSize) {
+    sum ^= bytes[i];
+  }
+  return sum ^ bytes[data.size() - 1];
+}
+
+struct warm_up_stats {
+  size_t tiles_{0}, packs_{0}, bytes_{0};
+};
+
+// Prepared tiles (keys are sorted by z first: a single range).
+inline void warm_up_prepared(lmdb::txn& txn, lmdb::txn::dbi tiles_dbi,
+                             uint32_t const max_z, warm_up_stats& stats,
+                             std::atomic_bool const& stop) {
+  auto const key_end = tile_to_key(0, 0, max_z + 1);
+  auto c = lmdb::cursor{txn, tiles_dbi};
+  for (auto el = c.get(lmdb::cursor_op::SET_RANGE, tile_to_key(0, 0, 0));
+       el && el->first < key_end && !stop;
+       el = c.get<tile_key_t>(lmdb::cursor_op::NEXT)) {
+    if (key_to_n(el->first) != 0) {
+      continue;  // not a tile (e.g. etag)
+    }
+    prefetch(el->second);
+    ++stats.tiles_;
+    stats.bytes_ += el->second.size();
+  }
+}
+
+// Queries for the feature packs of tiles: pack records are indexed on
+// kTileDefaultIndexZoomLvl, higher tiles share the query of their ancestor.
+inline std::vector<geo::tile> warm_up_pack_queries(
+    std::vector<geo::tile> const& tiles) {
+  std::vector<geo::tile> queries;
+  std::unordered_set<geo::tile> seen;
+  for (auto tile : tiles) {
+    while (tile.z_ > kTileDefaultIndexZoomLvl) {
+      tile = tile.parent();
+    }
+    if (seen.insert(tile).second) {
+      queries.push_back(tile);
+    }
+  }
+  return queries;
+}
+
+// Feature packs of the given tiles in the pack file (the pack records are
+// read by foreach_record(query tile, fn(tile, pack_record))).
+template <typename ForeachRecord, typename PackHandle>
+void warm_up_packs(ForeachRecord&& foreach_record, PackHandle const& packs,
+                   std::vector<geo::tile> const& tiles, warm_up_stats& stats,
+                   std::atomic_bool const& stop) {
+  std::unordered_set<size_t> seen;  // pack offsets
+  for (auto const& query : warm_up_pack_queries(tiles)) {
+    if (stop) {
+      return;
+    }
+    foreach_record(query, [&](auto const&, pack_record const& record) {
+      if (seen.insert(record.offset_).second) {
+        prefetch(packs.get(record));
+        ++stats.packs_;
+        stats.bytes_ += record.size_;
+      }
+    });
+  }
+}
+
+}  // namespace tiles
@@ -12,13 +12,30 @@
 
 namespace tiles {
 
-inline std::optional<feature> deserialize_feature(
+// nullopt: killed by the simplify masks of the zoom level
+inline std::optional<fixed_geometry> deserialize_geometry(
+    std::string_view const geometry,
+    std::vector<std::string_view> simplify_masks,
+    uint32_t const zoom_level_hint) {
+  if (zoom_level_hint != kInvalidZoomLevel && !simplify_masks.empty()) {
+    auto simplified =
+        deserialize(geometry, std::move(simplify_masks), zoom_level_hint);
+    if (mpark::holds_alternative<fixed_null>(simplified)) {
+      return std::nullopt;
+    }
+    return simplified;
+  }
+  return deserialize(geometry);
+}
+
+// on_geometry(bbox, geometry, simplify_masks) decides what happens to the
+// (still serialized) geometry: nullopt drops the feature.
+template <typename OnGeometry>
+std::optional<feature> deserialize_feature(
     std::string_view const& str,  //
     shared_metadata_decoder const& metadata_decoder,
-    fixed_box const& box_hint = {{kInvalidBoxHint, kInvalidBoxHint},
-                                 {kInvalidBoxHint, kInvalidBoxHint}},
-    uint32_t const zoom_level_hint = kInvalidZoomLevel) {
-
+    fixed_box const& box_hint, uint32_t const zoom_level_hint,
+    OnGeometry&& on_geometry) {
   uint64_t id = 0;
   std::pair<uint32_t, uint32_t> zoom_levels{kInvalidZoomLevel,
                                             kInvalidZoomLevel};
@@ -30,6 +47,7 @@ inline std::optional<feature> deserialize_feature(
   std::vector<metadata> meta;
 
   std::vector<std::string_view> simplify_masks;
+  fixed_box bbox;
   fixed_geometry geometry;
 
   namespace pz = protozero;
@@ -74,6 +92,8 @@ inline std::optional<feature> deserialize_feature(
           return std::nullopt;
         }
 
+        bbox = fixed_box{{min_x, min_y}, {max_x, max_y}};
+
         layer = static_cast<size_t>(next());  // layer key
         utl::verify(range.empty(), "read_header: superfluous elements");
       } break;
@@ -103,16 +123,12 @@ inline std::optional<feature> deserialize_feature(
 
         std::vector<std::string_view> simplify_masks_tmp;
         std::swap(simplify_masks, simplify_masks_tmp);
-        if (zoom_level_hint != kInvalidZoomLevel &&
-            !simplify_masks_tmp.empty()) {
-          geometry = deserialize(msg.get_view(), std::move(simplify_masks_tmp),
-                                 zoom_level_hint);
-          if (mpark::holds_alternative<fixed_null>(geometry)) {
-            return std::nullopt;  // killed by mask
-          }
-        } else {
-          geometry = deserialize(msg.get_view());
+        auto deserialized =
+            on_geometry(bbox, msg.get_view(), std::move(simplify_masks_tmp));
+        if (!deserialized) {
+          return std::nullopt;  // e.g. killed by mask
         }
+        geometry = std::move(*deserialized);
       } break;
       default: msg.skip();
     }
@@ -124,4 +140,19 @@ inline std::optional<feature> deserialize_feature(
   return feature{id, layer, zoom_levels, std::move(meta), std::move(geometry)};
 }
 
+inline std::optional<feature> deserialize_feature(
+    std::string_view const& str,  //
+    shared_metadata_decoder const& metadata_decoder,
+    fixed_box const& box_hint = {{kInvalidBoxHint, kInvalidBoxHint},
+                                 {kInvalidBoxHint, kInvalidBoxHint}},
+    uint32_t const zoom_level_hint = kInvalidZoomLevel) {
+  return deserialize_feature(
+      str, metadata_decoder, box_hint, zoom_level_hint,
+      [&](fixed_box const&, std::string_view const geometry,
+          std::vector<std::string_view> simplify_masks) {
+        return deserialize_geometry(geometry, std::move(simplify_masks),
+                                    zoom_level_hint);
+      });
+}
+
 }  // namespace tiles
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "tiles/db/feature_pack.h"
+#include "tiles/db/shared_metadata.h"
+#include "tiles/feature/deserialize.h"
+#include "tiles/feature/feature.h"
+#include "tiles/lru_cache.h"
+
+namespace tiles {
+
+// Decoded features shared across renders: one entry per span (= features of a
+// quad tree node) of a feature pack. The features are decoded once at full
+// resolution, every render only picks the visible ones and applies the
+// simplify masks of its zoom level (no protobuf and varint decoding).
+//
+// Entries are keyed by the address of the span and the simplify masks point
+// into the pack: the pack data must outlive the cache (e.g. the memory mapped
+// pack file of a database).
+
+// parts of the serialized feature to simplify it later (see
+// apply_simplify_masks), the masks point into the serialized feature
+struct unsimplified_feature_parts {
+  fixed_box bbox_;
+  std::vector<std::string_view> simplify_masks_;
+};
+
+struct cached_feature {
+  feature feature_;  // unsimplified geometry
+  unsimplified_feature_parts parts_;
+};
+
+struct cached_span {
+  size_t size() const { return memory_size_; }  // for lru_cache
+
+  std::vector<cached_feature> features_;
+  size_t span_size_{0};  // bytes in the pack (incl. terminator)
+  size_t memory_size_{0};  // rough estimate
+};
+
+using feature_cache = lru_cache<cached_span>;
+
+inline size_t memory_size(fixed_geometry const& geometry) {
+  constexpr auto const kPointSize = sizeof(fixed_xy);
+  return mpark::visit(
+      [](auto const& g) -> size_t {
+        using geometry_t = std::decay_t<decltype(g)>;
+        if constexpr (std::is_same_v<geometry_t, fixed_point>) {
+          return g.size() * kPointSize;
+        } else if constexpr (std::is_same_v<geometry_t, fixed_polyline>) {
+          size_t size = g.size() * sizeof(fixed_line);
+          for (auto const& line : g) {
+            size += line.size() * kPointSize;
+          }
+          return size;
+        } else if constexpr (std::is_same_v<geometry_t, fixed_polygon>) {
+          size_t size = g.size() * sizeof(fixed_simple_polygon);
+          for (auto const& polygon : g) {
+            size += polygon.outer().size() * kPointSize +
+                    polygon.inners().size() * sizeof(fixed_ring);
+            for (auto const& inner : polygon.inners()) {
+              size += inner.size() * kPointSize;
+            }
+          }
+          return size;
+        } else {
+          return 0;
+        }
+      },
+      geometry);
+}
+
+inline size_t memory_size(cached_feature const& f) {
+  auto size = sizeof(cached_feature) + memory_size(f.feature_.geometry_) +
+              f.parts_.simplify_masks_.size() * sizeof(std::string_view);
+  for (auto const& m : f.feature_.meta_) {
+    size += sizeof(metadata) + m.key_.capacity() + m.value_.capacity();
+  }
+  return size;
+}
+
+// string: the pack from the begin of the span on (see unpack_spans)
+inline std::shared_ptr<cached_span const> decode_span(
+    std::string_view const& string,
+    shared_metadata_decoder const& metadata_decoder) {
+  auto span = std::make_shared<cached_span>();
+  span->span_size_ = unpack_span(string, [&](auto const& feature_str) {
+    cached_feature f;
+    f.feature_ = *deserialize_feature(
+        feature_str, metadata_decoder,
+        {{kInvalidBoxHint, kInvalidBoxHint},
+         {kInvalidBoxHint, kInvalidBoxHint}},
+        kInvalidZoomLevel,
+        [&](fixed_box const& bbox, std::string_view const geometry,
+            std::vector<std::string_view> simplify_masks)
+            -> std::optional<fixed_geometry> {
+          f.parts_ = {bbox, std::move(simplify_masks)};
+          return deserialize_unsimplified(geometry);
+        });
+    span->features_.emplace_back(std::move(f));
+  });
+
+  span->memory_size_ = sizeof(cached_span) + span->features_.capacity() *
+                                                 sizeof(cached_feature);
+  for (auto const& f : span->features_) {
+    span->memory_size_ += memory_size(f) - sizeof(cached_feature);
+  }
+  return span;
+}
+
+inline std::shared_ptr<cached_span const> get_span(
+    feature_cache& cache, std::string_view const& string,
+    shared_metadata_decoder const& metadata_decoder) {
+  auto const key = reinterpret_cast<std::uintptr_t>(string.data());
+  if (auto span = cache.get(key); span != nullptr) {
+    return span;
+  }
+
+  auto span = decode_span(string, metadata_decoder);
+  cache.put(key, span);
+  return span;
+}
+
+// same result as deserialize_feature(str, decoder, box_hint, zoom_level_hint)
+inline std::optional<feature> materialize_feature(cached_feature const& f,
+                                                  fixed_box const& box_hint,
+                                                  uint32_t const z) {
+  auto const& zoom_levels = f.feature_.zoom_levels_;
+  if (zoom_levels.first > z || zoom_levels.second < z) {
+    return std::nullopt;
+  }
+
+  auto const& bbox = f.parts_.bbox_;
+  if (bbox.max_corner().x() < box_hint.min_corner().x() ||
+      bbox.min_corner().x() > box_hint.max_corner().x() ||
+      bbox.max_corner().y() < box_hint.min_corner().y() ||
+      bbox.min_corner().y() > box_hint.max_corner().y()) {
+    return std::nullopt;
+  }
+
+  auto const& masks = f.parts_.simplify_masks_;
+  auto geometry = apply_simplify_masks(f.feature_.geometry_, masks, z);
+  if (!masks.empty() && mpark::holds_alternative<fixed_null>(geometry)) {
+    return std::nullopt;  // killed by mask
+  }
+
+  return feature{f.feature_.id_, f.feature_.layer_, zoom_levels,
+                 f.feature_.meta_, std::move(geometry)};
+}
+
+}  // namespace tiles
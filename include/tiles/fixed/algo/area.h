@@ -2,6 +2,8 @@
 
 #include "boost/geometry.hpp"
 
+#include "tiles/fixed/fixed_geometry.h"
+
 namespace tiles {
 
 inline fixed_coord_t area(fixed_null const&) { return 0; }
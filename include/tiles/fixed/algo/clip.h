@@ -6,4 +6,17 @@ namespace tiles {
 
 fixed_geometry clip(fixed_geometry const&, fixed_box const&);
 
+// bbox (of a geometry) strictly inside box: clipping would not change the
+// geometry, correct_orientation is sufficient
+inline bool is_contained(fixed_box const& bbox, fixed_box const& box) {
+  return bbox.min_corner().x() > box.min_corner().x() &&
+         bbox.min_corner().y() > box.min_corner().y() &&
+         bbox.max_corner().x() < box.max_corner().x() &&
+         bbox.max_corner().y() < box.max_corner().y();
+}
+
+// instead of clip for contained geometries: polygons get the ring orientation
+// of clipped polygons, everything else is left as is
+void correct_orientation(fixed_geometry&);
+
 }  // namespace tiles
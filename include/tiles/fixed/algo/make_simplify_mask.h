@@ -4,6 +4,8 @@
 
 #include "geo/simplify_mask.h"
 
+#include "tiles/fixed/fixed_geometry.h"
+
 namespace tiles {
 
 inline std::vector<std::string> make_simplify_mask(fixed_null const&) {
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "tiles/fixed/fixed_geometry.h"
+#include "tiles/fixed/io/tags.h"
 
 namespace tiles {
 
@@ -11,4 +14,17 @@ fixed_geometry deserialize(std::string_view geo,
                            std::vector<std::string_view> simplify_masks,
                            uint32_t z);
 
+// Type of a serialized geometry (without deserializing it).
+tags::fixed_geometry_type geometry_type(std::string_view geo);
+
+// Full resolution geometry which can be simplified later: degenerate polygon
+// rings are kept (the simplify masks refer to them).
+fixed_geometry deserialize_unsimplified(std::string_view geo);
+
+// Same result as deserialize(geo, simplify_masks, z) from the result of
+// deserialize_unsimplified(geo). Without masks: like deserialize(geo).
+fixed_geometry apply_simplify_masks(
+    fixed_geometry const& unsimplified,
+    std::vector<std::string_view> const& simplify_masks, uint32_t z);
+
 }  // namespace tiles
@@ -1,17 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
 #include "geo/tile.h"
 #include "lmdb/lmdb.hpp"
 
+#include "tiles/cancel_token.h"
 #include "tiles/db/bq_tree.h"
 #include "tiles/db/feature_pack.h"
 #include "tiles/db/layer_names.h"
 #include "tiles/db/pack_file.h"
+#include "tiles/db/read_txn_pool.h"
 #include "tiles/db/shared_metadata.h"
 #include "tiles/db/tile_database.h"
 #include "tiles/db/tile_index.h"
 #include "tiles/feature/deserialize.h"
+#include "tiles/feature/feature_cache.h"
 #include "tiles/fixed/algo/bounding_box.h"
+#include "tiles/mvt/overzoom.h"
 #include "tiles/mvt/tile_builder.h"
 #include "tiles/mvt/tile_spec.h"
 #include "tiles/perf_counter.h"
@@ -36,6 +44,44 @@ struct render_ctx {
   bool tb_aggregate_polygons_ = false;
   bool tb_drop_subpixel_polygons_ = true;
   bool tb_print_stats_ = false;
+
+  std::chrono::milliseconds render_budget_{0};  // 0: unlimited
+
+  // tiles above are sliced from their ancestor on this level (no more detail)
+  uint32_t max_data_zoom_level_ = kMaxZoomLevel;
+
+  // shared by all renders (copies) of the database; nullptr: no caching
+  std::shared_ptr<feature_cache> feature_cache_{};
+};
+
+struct render_budget_exceeded : public std::exception {
+  char const* what() const noexcept override {
+    return "render budget exceeded";
+  }
+};
+
+// Checked for every feature pack and feature of a render: throws
+// render_cancelled or render_budget_exceeded (clock read every 64th check).
+struct render_guard {
+  using clock_t = std::chrono::steady_clock;
+
+  render_guard(render_ctx const& ctx, cancel_token const& cancel)
+      : cancel_{cancel},
+        deadline_{ctx.render_budget_.count() == 0
+                      ? clock_t::time_point::max()
+                      : clock_t::now() + ctx.render_budget_} {}
+
+  void check() {
+    throw_if_cancelled(cancel_);
+    if (deadline_ != clock_t::time_point::max() && ++checks_ % 64 == 0 &&
+        clock_t::now() > deadline_) {
+      throw render_budget_exceeded{};
+    }
+  }
+
+  cancel_token const& cancel_;
+  clock_t::time_point deadline_;
+  size_t checks_{0};
 };
 
 inline render_ctx make_render_ctx(tile_db_handle& db_handle) {
@@ -101,23 +147,25 @@ void pack_records_foreach(lmdb::cursor& c, geo::tile const& query_tile,
   }
 }
 
+// throws render_cancelled / render_budget_exceeded (see render_guard)
 template <typename ForeachPack, typename PerfCounter>
 size_t render_features(tile_builder& builder, render_ctx const& ctx,
                        geo::tile const& tile, ForeachPack&& foreach_pack,
-                       PerfCounter& pc) {
+                       PerfCounter& pc,
+                       cancel_token const& cancel = never_cancelled()) {
   size_t added_features = 0;
   auto const box = tile_spec{tile}.draw_bounds_;  // XXX really with overdraw?
+  render_guard guard{ctx, cancel};
 
   start<perf_task::RENDER_TILE_QUERY_FEATURE>(pc);
   foreach_pack([&](auto const& db_tile, auto const& pack_str) {
     stop<perf_task::RENDER_TILE_QUERY_FEATURE>(pc);
     stop<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+    guard.check();
 
-    unpack_features(db_tile, pack_str, tile, [&](auto const& feature_str) {
-      start<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
-      start<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
-      auto const feature =
-          deserialize_feature(feature_str, ctx.metadata_decoder_, box, tile.z_);
+    // bbox: from the feature header (not clipped if inside the draw bounds)
+    auto const add_feature = [&](std::optional<feature> feature,
+                                 fixed_box const& bbox) {
       if (!feature) {
         stop<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
         start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
@@ -126,9 +174,61 @@ size_t render_features(tile_builder& builder, render_ctx const& ctx,
       stop<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
 
       start<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
-      builder.add_feature(std::move(*feature));
+      builder.add_feature(std::move(*feature), bbox);
       ++added_features;
       stop<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+    };
+
+    if (ctx.feature_cache_ != nullptr &&
+        unpack_spans(db_tile, pack_str, tile, tile.z_, [&](auto const& span) {
+          auto const cached =
+              get_span(*ctx.feature_cache_, span, ctx.metadata_decoder_);
+          for (auto const& f : cached->features_) {
+            guard.check();
+            start<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+            start<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+            add_feature(materialize_feature(f, box, tile.z_), f.parts_.bbox_);
+          }
+          return cached->span_size_;
+        })) {
+      start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+      return;
+    }
+
+    unpack_features(db_tile, pack_str, tile, [&](auto const& feature_str) {
+      guard.check();
+      start<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+      start<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+
+      // contained points and lines: geometry streamed into the tile as is
+      fixed_box feature_bbox;
+      std::string_view transcode_geometry;
+      std::vector<std::string_view> transcode_masks;
+      auto feature = deserialize_feature(
+          feature_str, ctx.metadata_decoder_, box, tile.z_,
+          [&](fixed_box const& bbox, std::string_view const geometry,
+              std::vector<std::string_view> simplify_masks)
+              -> std::optional<fixed_geometry> {
+            feature_bbox = bbox;
+            if (builder.can_transcode(bbox, geometry_type(geometry))) {
+              transcode_geometry = geometry;
+              transcode_masks = std::move(simplify_masks);
+              return fixed_null{};
+            }
+            return deserialize_geometry(geometry, std::move(simplify_masks),
+                                        tile.z_);
+          });
+
+      if (feature && !transcode_geometry.empty()) {
+        stop<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+        start<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+        builder.add_feature(std::move(*feature), transcode_geometry,
+                            transcode_masks);
+        ++added_features;
+        stop<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+      } else {
+        add_feature(std::move(feature), feature_bbox);
+      }
     });
 
     start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
@@ -136,29 +236,26 @@ size_t render_features(tile_builder& builder, render_ctx const& ctx,
   return added_features;
 }
 
-template <typename ForeachPack, typename PerfCounter>
-std::optional<std::string> get_tile(render_ctx const& ctx,
-                                    geo::tile const& tile,
-                                    ForeachPack&& foreach_pack,
-                                    PerfCounter& pc) {
-  start<perf_task::GET_TILE_RENDER>(pc);
-
-  tile_builder builder{ctx, tile};
-  render_seaside(builder, ctx, tile, pc);
-  auto const rendered_features = render_features(
-      builder, ctx, tile, std::forward<ForeachPack>(foreach_pack), pc);
-
+// empty result: no tile
+template <typename PerfCounter>
+std::string finish_tile(render_ctx const& ctx, geo::tile const& tile,
+                        tile_builder const& builder,
+                        size_t const rendered_features, PerfCounter& pc) {
   if (ctx.ignore_fully_seaside_ && ctx.seaside_tiles_.contains(tile) &&
       rendered_features == 0) {
-    return std::nullopt;
+    return {};
   }
 
   start<perf_task::RENDER_TILE_FINISH>(pc);
   auto rendered_tile = builder.finish();
   stop<perf_task::RENDER_TILE_FINISH>(pc);
+  return rendered_tile;
+}
 
-  stop<perf_task::GET_TILE_RENDER>(pc);
-
+template <typename PerfCounter>
+std::optional<std::string> compress_tile(render_ctx const& ctx,
+                                         std::string rendered_tile,
+                                         PerfCounter& pc) {
   if (rendered_tile.empty()) {
     return std::nullopt;
   }
@@ -175,20 +272,285 @@ std::optional<std::string> get_tile(render_ctx const& ctx,
   }
 }
 
+template <typename ForeachPack, typename PerfCounter>
+std::optional<std::string> get_tile(
+    render_ctx const& ctx, geo::tile const& tile, ForeachPack&& foreach_pack,
+    PerfCounter& pc, cancel_token const& cancel = never_cancelled()) {
+  start<perf_task::GET_TILE_RENDER>(pc);
+
+  tile_builder builder{ctx, tile};
+  render_seaside(builder, ctx, tile, pc);
+  auto const rendered_features = render_features(
+      builder, ctx, tile, std::forward<ForeachPack>(foreach_pack), pc, cancel);
+  auto rendered_tile =
+      finish_tile(ctx, tile, builder, rendered_features, pc);
+
+  stop<perf_task::GET_TILE_RENDER>(pc);
+
+  return compress_tile(ctx, std::move(rendered_tile), pc);
+}
+
+// ancestor on the max data zoom level (tile itself if not above)
+inline geo::tile data_tile(render_ctx const& ctx, geo::tile tile) {
+  while (tile.z_ > ctx.max_data_zoom_level_) {
+    tile = tile.parent();
+  }
+  return tile;
+}
+
+// tile from the result of get_tile for its data_tile
 template <typename PerfCounter>
-std::optional<std::string> get_tile(tile_db_handle& handle, lmdb::txn& txn,
+std::optional<std::string> slice_tile(render_ctx const& ctx,
+                                      geo::tile const& ancestor,
+                                      std::string_view ancestor_tile,
+                                      geo::tile const& tile, PerfCounter& pc) {
+  if (ancestor_tile.empty()) {
+    return std::nullopt;
+  }
+
+  start<perf_task::GET_TILE_OVERZOOM>(pc);
+  auto sliced = overzoom_tile(ctx.compress_result_
+                                  ? decompress_deflate(ancestor_tile)
+                                  : std::string{ancestor_tile},
+                              ancestor, tile);
+  stop<perf_task::GET_TILE_OVERZOOM>(pc);
+
+  return compress_tile(ctx, std::move(sliced), pc);
+}
+
+using metatile_t =
+    std::vector<std::pair<geo::tile, std::optional<std::string>>>;
+
+// Root of the metatile (2^levels x 2^levels tiles) containing tile.
+// Low zoom levels have smaller metatiles: the root is at most z = 0.
+inline geo::tile metatile_root(geo::tile tile, uint32_t const levels) {
+  for (auto i = 0U; i < levels && tile.z_ != 0; ++i) {
+    tile = tile.parent();
+  }
+  return tile;
+}
+
+// Renders all tiles on zoom level z (below root) at once.
+//
+// Packs are queried and unpacked once for the whole metatile and every
+// feature is deserialized (or taken from the feature cache) once, then added
+// to all tiles it touches (bbox of the feature header) whose own spatial
+// query yields its span.
+// Same results as get_tile for every single tile.
+template <typename ForeachPack, typename PerfCounter>
+metatile_t get_metatile(render_ctx const& ctx, geo::tile const& root,
+                        uint32_t const z, ForeachPack&& foreach_pack,
+                        PerfCounter& pc,
+                        cancel_token const& cancel = never_cancelled()) {
+  utl::verify(z >= root.z_ && z <= kMaxZoomLevel, "invalid metatile zoom");
+
+  start<perf_task::GET_TILE_RENDER>(pc);
+
+  std::vector<geo::tile> tiles;
+  std::vector<fixed_box> boxes;
+  std::vector<tile_builder> builders;
+  auto const bounds = root.bounds_on_z(z);
+  for (auto y = bounds.miny_; y < bounds.maxy_; ++y) {
+    for (auto x = bounds.minx_; x < bounds.maxx_; ++x) {
+      geo::tile const tile{x, y, z};
+      tiles.push_back(tile);
+      boxes.push_back(tile_spec{tile}.draw_bounds_);
+      builders.emplace_back(ctx, tile);
+      render_seaside(builders.back(), ctx, tile, pc);
+    }
+  }
+  std::vector<size_t> rendered_features(tiles.size(), 0);
+
+  // draw bounds of the tiles: tiles are sorted by y, x
+  fixed_box const box{boxes.front().min_corner(), boxes.back().max_corner()};
+
+  // (span, tile) for the spans in the spatial query of each tile: get_tile
+  // does not see features of other spans (even inside its overdraw)
+  std::vector<std::pair<char const*, size_t>> span_tiles;
+  std::vector<size_t> candidates;  // tiles which see the current span
+  std::vector<size_t> matches;  // candidates touched by the feature bbox
+  auto const match_tiles = [&](fixed_box const& bbox) {
+    matches.clear();
+    for (auto const i : candidates) {
+      auto const& b = boxes[i];
+      if (bbox.max_corner().x() < b.min_corner().x() ||
+          bbox.min_corner().x() > b.max_corner().x() ||
+          bbox.max_corner().y() < b.min_corner().y() ||
+          bbox.min_corner().y() > b.max_corner().y()) {
+        continue;
+      }
+      matches.push_back(i);
+    }
+  };
+
+  render_guard guard{ctx, cancel};
+  start<perf_task::RENDER_TILE_QUERY_FEATURE>(pc);
+  foreach_pack([&](auto const& db_tile, auto const& pack_str) {
+    stop<perf_task::RENDER_TILE_QUERY_FEATURE>(pc);
+    stop<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+    guard.check();
+
+    // adds the feature to the tiles in matches (see match_tiles)
+    // bbox: from the feature header (decides about clipping, as in
+    // render_features)
+    auto const add_to_matches = [&](feature&& f, fixed_box const& bbox) {
+      for (auto const i : matches) {
+        // the last one may take ownership
+        builders[i].add_feature(i == matches.back() ? std::move(f) : f, bbox);
+        ++rendered_features[i];
+      }
+    };
+
+    auto const add_cached_feature = [&](cached_feature const& f) {
+      guard.check();
+      start<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+      start<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+      auto feature = materialize_feature(f, box, z);
+      if (!feature) {
+        stop<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+        start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+        return;
+      }
+      stop<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+
+      start<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+      match_tiles(f.parts_.bbox_);
+      add_to_matches(std::move(*feature), f.parts_.bbox_);
+      stop<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+    };
+
+    // contained points and lines are streamed into each tile as is (see
+    // render_features), the geometry is only deserialized for the others
+    auto const render_feature = [&](auto const& feature_str) {
+      guard.check();
+      start<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+      start<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+      fixed_box header_bbox;
+      std::string_view geometry;
+      std::vector<std::string_view> simplify_masks;
+      auto feature = deserialize_feature(
+          feature_str, ctx.metadata_decoder_, box, z,
+          [&](fixed_box const& bbox, std::string_view const geo,
+              std::vector<std::string_view> masks)
+              -> std::optional<fixed_geometry> {
+            header_bbox = bbox;
+            geometry = geo;
+            simplify_masks = std::move(masks);
+            return fixed_null{};  // later, if needed
+          });
+      if (!feature) {
+        stop<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+        start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+        return;
+      }
+
+      match_tiles(header_bbox);
+      auto const type = geometry_type(geometry);
+      auto const deserialize_end =
+          std::partition(begin(matches), end(matches), [&](auto const i) {
+            return builders[i].can_transcode(header_bbox, type);
+          });
+      start<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+      for (auto it = begin(matches); it != deserialize_end; ++it) {
+        builders[*it].add_feature(*feature, geometry, simplify_masks);
+        ++rendered_features[*it];
+      }
+      stop<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+      matches.erase(begin(matches), deserialize_end);
+
+      if (!matches.empty()) {
+        auto deserialized =
+            deserialize_geometry(geometry, std::move(simplify_masks), z);
+        if (!deserialized) {
+          stop<perf_task::RENDER_TILE_DESER_FEATURE_SKIP>(pc);
+          start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+          return;  // killed by mask
+        }
+        feature->geometry_ = std::move(*deserialized);
+      }
+      stop<perf_task::RENDER_TILE_DESER_FEATURE_OKAY>(pc);
+
+      start<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+      add_to_matches(std::move(*feature), header_bbox);
+      stop<perf_task::RENDER_TILE_ADD_FEATURE>(pc);
+    };
+
+    span_tiles.clear();
+    for (auto i = 0ULL; i < tiles.size(); ++i) {
+      unpack_spans(db_tile, pack_str, tiles[i], z, [&](auto const& span) {
+        span_tiles.emplace_back(span.data(), i);
+        return unpack_span(span, [](auto const&) {});
+      });
+    }
+    std::sort(begin(span_tiles), end(span_tiles));
+
+    if (!unpack_spans(db_tile, pack_str, root, z, [&](auto const& span) {
+          candidates.clear();
+          for (auto it = std::lower_bound(begin(span_tiles), end(span_tiles),
+                                          std::pair{span.data(), size_t{0}});
+               it != end(span_tiles) && it->first == span.data(); ++it) {
+            candidates.push_back(it->second);
+          }
+
+          if (ctx.feature_cache_ == nullptr) {
+            return unpack_span(span, render_feature);
+          }
+
+          auto const cached =
+              get_span(*ctx.feature_cache_, span, ctx.metadata_decoder_);
+          for (auto const& f : cached->features_) {
+            add_cached_feature(f);
+          }
+          return cached->span_size_;
+        })) {
+      // no quad tree available: every tile sees all features
+      candidates.resize(tiles.size());
+      std::iota(begin(candidates), end(candidates), size_t{0});
+      unpack_features(pack_str, render_feature);
+    }
+
+    start<perf_task::RENDER_TILE_ITER_FEATURE>(pc);
+  });
+
+  std::vector<std::string> rendered_tiles;
+  rendered_tiles.reserve(tiles.size());
+  for (auto i = 0ULL; i < tiles.size(); ++i) {
+    rendered_tiles.push_back(
+        finish_tile(ctx, tiles[i], builders[i], rendered_features[i], pc));
+  }
+  stop<perf_task::GET_TILE_RENDER>(pc);
+
+  metatile_t result;
+  result.reserve(tiles.size());
+  for (auto i = 0ULL; i < tiles.size(); ++i) {
+    result.emplace_back(tiles[i],
+                        compress_tile(ctx, std::move(rendered_tiles[i]), pc));
+  }
+  return result;
+}
+
+template <typename PerfCounter>
+std::optional<std::string> get_tile(lmdb::txn& txn, lmdb::txn::dbi tiles_dbi,
                                     lmdb::cursor& features_cursor,
                                     pack_handle const& pack_handle,
                                     render_ctx const& ctx,
-                                    geo::tile const& tile, PerfCounter& pc) {
+                                    geo::tile const& tile, PerfCounter& pc,
+                                    cancel_token const& cancel =
+                                        never_cancelled()) {
   utl::verify(tile.z_ <= kMaxZoomLevel, "invalid zoom level");
 
+  if (tile.z_ > ctx.max_data_zoom_level_) {
+    auto const ancestor = data_tile(ctx, tile);
+    auto const ancestor_tile = get_tile(txn, tiles_dbi, features_cursor,
+                                        pack_handle, ctx, ancestor, pc, cancel);
+    return slice_tile(ctx, ancestor, ancestor_tile.value_or(std::string{}),
+                      tile, pc);
+  }
+
   auto total = scoped_perf_counter<perf_task::GET_TILE_TOTAL>(pc);
 
   if (!ctx.ignore_prepared_ &&
       static_cast<int>(tile.z_) <= ctx.max_prepared_zoom_level_) {
-    auto tiles_dbi = handle.tiles_dbi(txn);
-
     start<perf_task::GET_TILE_FETCH>(pc);
     auto db_tile = txn.get(tiles_dbi, tile_to_key(tile));
     stop<perf_task::GET_TILE_FETCH>(pc);
@@ -212,7 +574,52 @@ std::optional<std::string> get_tile(tile_db_handle& handle, lmdb::txn& txn,
           fn(t, pack_handle.get(r));
         });
       },
-      pc);
+      pc, cancel);
+}
+
+template <typename PerfCounter>
+std::optional<std::string> get_tile(tile_db_handle& handle, lmdb::txn& txn,
+                                    lmdb::cursor& features_cursor,
+                                    pack_handle const& pack_handle,
+                                    render_ctx const& ctx,
+                                    geo::tile const& tile, PerfCounter& pc) {
+  return get_tile(txn, handle.tiles_dbi(txn), features_cursor, pack_handle,
+                  ctx, tile, pc);
+}
+
+template <typename PerfCounter>
+std::optional<std::string> get_tile(
+    read_txn& txn, pack_handle const& pack_handle, render_ctx const& ctx,
+    geo::tile const& tile, PerfCounter& pc,
+    cancel_token const& cancel = never_cancelled()) {
+  return get_tile(txn.txn(), txn.tiles_dbi(), txn.features_cursor(),
+                  pack_handle, ctx, tile, pc, cancel);
+}
+
+template <typename PerfCounter>
+metatile_t get_metatile(lmdb::cursor& features_cursor,
+                        pack_handle const& pack_handle, render_ctx const& ctx,
+                        geo::tile const& root, uint32_t const z,
+                        PerfCounter& pc,
+                        cancel_token const& cancel = never_cancelled()) {
+  auto total = scoped_perf_counter<perf_task::GET_TILE_TOTAL>(pc);
+  return get_metatile(
+      ctx, root, z,
+      [&](auto&& fn) {
+        pack_records_foreach(features_cursor, root, [&](auto t, auto r) {
+          fn(t, pack_handle.get(r));
+        });
+      },
+      pc, cancel);
+}
+
+template <typename PerfCounter>
+metatile_t get_metatile(read_txn& txn, pack_handle const& pack_handle,
+                        render_ctx const& ctx, geo::tile const& root,
+                        uint32_t const z, PerfCounter& pc,
+                        cancel_token const& cancel = never_cancelled()) {
+  return get_metatile(txn.features_cursor(), pack_handle, ctx, root, z, pc,
+                      cancel);
 }
 
 template <typename PerfCounter>
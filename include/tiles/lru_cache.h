@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utl/verify.h"
+
+namespace tiles {
+
+// Memory bounded LRU cache for immutable values (Value::size(): bytes).
+//
+// The key space is split into independent shards (each with its own lock and
+// byte budget) to keep lock contention low with many server threads. Values
+// are shared and immutable: an entry evicted while a reader still references
+// it stays alive until the reader is done.
+template <typename Value>
+struct lru_cache {
+  using cache_key_t = uint64_t;
+  using value_t = std::shared_ptr<Value const>;
+
+  // rough per entry bookkeeping cost: list node, hash node, control block
+  static constexpr size_t kEntryOverhead = 128;
+
+  struct stats {
+    uint64_t hits_{0}, misses_{0}, insertions_{0}, evictions_{0};
+    uint64_t entries_{0}, size_{0};
+  };
+
+  explicit lru_cache(size_t const max_size, size_t const shard_count = 16)
+      : shards_(shard_count) {
+    utl::verify(shard_count != 0, "lru_cache: need at least one shard");
+    for (auto& shard : shards_) {
+      shard = std::make_unique<cache_shard>(max_size / shard_count);
+    }
+  }
+
+  value_t get(cache_key_t const key) {
+    auto& shard = get_shard(key);
+    std::lock_guard<std::mutex> l{shard.mutex_};
+
+    auto const it = shard.map_.find(key);
+    if (it == end(shard.map_)) {
+      ++misses_;
+      return nullptr;
+    }
+
+    ++hits_;
+    shard.lru_.splice(begin(shard.lru_), shard.lru_, it->second);
+    return it->second->second;
+  }
+
+  void put(cache_key_t const key, value_t value) {
+    utl::verify(value != nullptr, "lru_cache: cannot store nullptr");
+
+    auto& shard = get_shard(key);
+    auto const size = entry_size(value);
+    if (size > shard.max_size_) {
+      return;  // would evict the entire shard
+    }
+
+    std::lock_guard<std::mutex> l{shard.mutex_};
+    if (auto const it = shard.map_.find(key); it != end(shard.map_)) {
+      shard.size_ -= entry_size(it->second->second);
+      shard.lru_.erase(it->second);
+      shard.map_.erase(it);
+    }
+
+    while (!shard.lru_.empty() && shard.size_ + size > shard.max_size_) {
+      auto const& victim = shard.lru_.back();
+      shard.size_ -= entry_size(victim.second);
+      shard.map_.erase(victim.first);
+      shard.lru_.pop_back();
+      ++evictions_;
+    }
+
+    shard.lru_.emplace_front(key, std::move(value));
+    shard.map_.emplace(key, begin(shard.lru_));
+    shard.size_ += size;
+    ++insertions_;
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> l{shard->mutex_};
+      shard->map_.clear();
+      shard->lru_.clear();
+      shard->size_ = 0;
+    }
+  }
+
+  stats get_stats() const {
+    stats s;
+    s.hits_ = hits_;
+    s.misses_ = misses_;
+    s.insertions_ = insertions_;
+    s.evictions_ = evictions_;
+    for (auto const& shard : shards_) {
+      std::lock_guard<std::mutex> l{shard->mutex_};
+      s.entries_ += shard->map_.size();
+      s.size_ += shard->size_;
+    }
+    return s;
+  }
+
+private:
+  using lru_list_t = std::list<std::pair<cache_key_t, value_t>>;
+
+  struct cache_shard {
+    explicit cache_shard(size_t const max_size) : max_size_{max_size} {}
+
+    mutable std::mutex mutex_;
+    lru_list_t lru_;  // front: most recently used
+    std::unordered_map<cache_key_t, typename lru_list_t::iterator> map_;
+    size_t size_{0};
+    size_t max_size_;
+  };
+
+  static size_t entry_size(value_t const& value) {
+    return value->size() + kEntryOverhead;
+  }
+
+  cache_shard& get_shard(cache_key_t const key) {
+    // neighboring keys (tiles: low x/y bits) differ in few bits -> mix all
+    auto const hash = (key ^ (key >> 29U)) * 0x9E3779B97F4A7C15ULL;
+    return *shards_[(hash >> 32U) % shards_.size()];
+  }
+
+  std::vector<std::unique_ptr<cache_shard>> shards_;
+  std::atomic_uint64_t hits_{0}, misses_{0}, insertions_{0}, evictions_{0};
+};
+
+}  // namespace tiles
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string_view>
+#include <vector>
+
 #include "protozero/pbf_builder.hpp"
 
 #include "tiles/fixed/fixed_geometry.h"
@@ -12,4 +15,14 @@ namespace tiles {
 void encode_geometry(protozero::pbf_builder<tags::mvt::Feature>&,
                      fixed_geometry const&, tile_spec const&);
 
+// Streams a serialized point or polyline geometry (see fixed/io/serialize.h)
+// which lies within the draw bounds directly into MVT commands: same result
+// as encode_geometry(shift(deserialize(geo, simplify_masks, z), z)) without
+// clipping and without a fixed_geometry in between. buf is scratch space.
+// Returns false (and writes nothing) if nothing remains after shifting.
+bool transcode_geometry(protozero::pbf_builder<tags::mvt::Feature>&,
+                        std::string_view geo,
+                        std::vector<std::string_view> const& simplify_masks,
+                        tile_spec const&, std::vector<uint32_t>& buf);
+
 }  // namespace tiles
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "geo/tile.h"
+
+namespace tiles {
+
+// Cheap substitute for a render of tile: geometries of an already rendered
+// ancestor tile are scaled up, clipped to the draw bounds of tile and
+// re-encoded. Layers, feature ids and tags are kept (no generalization or
+// features of higher zoom levels, though).
+//
+// In- and output are uncompressed MVT. Empty result: nothing left.
+std::string overzoom_tile(std::string_view ancestor_mvt,
+                          geo::tile const& ancestor, geo::tile const& tile);
+
+}  // namespace tiles
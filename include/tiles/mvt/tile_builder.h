@@ -1,10 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <string_view>
+#include <vector>
 
 #include "geo/tile.h"
 
 #include "tiles/feature/feature.h"
+#include "tiles/fixed/io/tags.h"
 
 namespace tiles {
 
@@ -15,12 +18,24 @@ struct tile_builder {
   ~tile_builder();
 
   tile_builder(tile_builder const&) = delete;
-  tile_builder(tile_builder&&) noexcept = default;
+  tile_builder(tile_builder&&) noexcept;
   tile_builder& operator=(tile_builder const&) = delete;
-  tile_builder& operator=(tile_builder&&) noexcept = default;
+  tile_builder& operator=(tile_builder&&) noexcept;
 
   void add_feature(feature) const;
 
+  // bbox: of the geometry (e.g. from the serialized feature), features
+  // strictly inside the draw bounds are not clipped
+  void add_feature(feature, fixed_box const& bbox) const;
+
+  // points and lines strictly inside the draw bounds which are not aggregated
+  bool can_transcode(fixed_box const& bbox, tags::fixed_geometry_type) const;
+
+  // geometry stays serialized (f.geometry_ is ignored): streamed into the
+  // tile by transcode_geometry, only for features passing can_transcode
+  void add_feature(feature f, std::string_view geometry,
+                   std::vector<std::string_view> const& simplify_masks) const;
+
   std::string finish() const;
 
   struct impl;
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <charconv>
 #include <optional>
+#include <string>
+#include <string_view>
 
 #include "geo/tile.h"
 
+#include "tiles/constants.h"
 #include "tiles/util.h"
 
 namespace tiles {
@@ -14,14 +18,137 @@ geo::tile url_match_to_tile(RegexResult const& rr) {
   return geo::tile{stou(rr[2]), stou(rr[3]), stou(rr[1])};
 }
 
-inline std::optional<geo::tile> parse_tile_url(std::string const& url) {
-  static regex_matcher matcher{R"(.*\/(\d+)\/(\d+)\/(\d+).mvt$)"};
-  auto match = matcher.match(url);
-  if (!match) {
+namespace detail {
+
+// consumes a non-empty run of digits
+inline bool consume_uint(std::string_view& sv, uint32_t& out) {
+  if (sv.empty() || sv.front() < '0' || sv.front() > '9') {
+    return false;
+  }
+  auto const [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), out);
+  if (ec != std::errc{}) {
+    return false;
+  }
+  sv.remove_prefix(static_cast<size_t>(ptr - sv.data()));
+  return true;
+}
+
+inline bool consume(std::string_view& sv, std::string_view const prefix) {
+  if (sv.substr(0, prefix.size()) != prefix) {
+    return false;
+  }
+  sv.remove_prefix(prefix.size());
+  return true;
+}
+
+}  // namespace detail
+
+// Parses exactly "/{z}/{x}/{y}.mvt" (no allocation, no regex).
+// Tiles outside the valid range of their zoom level are rejected.
+inline std::optional<geo::tile> parse_tile_path(std::string_view path) {
+  uint32_t x = 0, y = 0, z = 0;
+  if (!(detail::consume(path, "/") && detail::consume_uint(path, z) &&
+        detail::consume(path, "/") && detail::consume_uint(path, x) &&
+        detail::consume(path, "/") && detail::consume_uint(path, y) &&
+        path == ".mvt")) {
+    return std::nullopt;
+  }
+
+  if (z > static_cast<uint32_t>(kMaxZoomLevel) || x >= (1U << z) ||
+      y >= (1U << z)) {
+    return std::nullopt;
+  }
+  return geo::tile{x, y, z};
+}
+
+// Accepts any prefix before "/{z}/{x}/{y}.mvt", e.g. a full url.
+inline std::optional<geo::tile> parse_tile_url(std::string_view const url) {
+  auto slashes = 0;
+  for (auto i = url.size(); i != 0; --i) {
+    if (url[i - 1] == '/' && ++slashes == 3) {
+      return parse_tile_path(url.substr(i - 1));
+    }
+  }
+  return std::nullopt;
+}
+
+// Decodes %XX escapes and '+'. Returns false for malformed escapes.
+inline bool url_decode(std::string_view const in, std::string& out) {
+  auto const hex = [](char const c) -> int {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  };
+
+  out.clear();
+  out.reserve(in.size());
+  for (auto i = 0ULL; i < in.size(); ++i) {
+    if (in[i] == '%') {
+      if (i + 2 >= in.size()) {
+        return false;
+      }
+      auto const hi = hex(in[i + 1]), lo = hex(in[i + 2]);
+      if (hi == -1 || lo == -1) {
+        return false;
+      }
+      out += static_cast<char>(hi * 16 + lo);
+      i += 2;
+    } else if (in[i] == '+') {
+      out += ' ';
+    } else {
+      out += in[i];
+    }
+  }
+  return true;
+}
+
+// Single pass request routing for tiles-server.
+//
+// The request target is split at '?' (query is ignored). For glyphs and
+// files path_ is the raw (still url encoded) remainder after the prefix.
+struct url_route {
+  enum class kind { NOT_FOUND, TILE, GLYPHS, METRICS, HEALTH, BATCH, FILE };
+
+  kind kind_{kind::NOT_FOUND};
+  geo::tile tile_{};
+  std::string_view path_;
+};
+
+inline url_route route_url(std::string_view target) {
+  target = target.substr(0, target.find('?'));
+
+  if (target.empty() || target.front() != '/') {
     return {};
   }
 
-  return url_match_to_tile(*match);
+  if (target.size() > 4 && target.substr(target.size() - 4) == ".mvt") {
+    if (auto const tile = parse_tile_path(target); tile.has_value()) {
+      return {url_route::kind::TILE, *tile, {}};
+    }
+  }
+
+  if (auto rest = target; detail::consume(rest, "/glyphs/") && !rest.empty()) {
+    return {url_route::kind::GLYPHS, {}, rest};
+  }
+
+  if (target == "/metrics") {
+    return {url_route::kind::METRICS, {}, {}};
+  }
+  if (target == "/health") {
+    return {url_route::kind::HEALTH, {}, {}};
+  }
+  if (target == "/batch") {
+    return {url_route::kind::BATCH, {}, {}};
+  }
+  if (target == "/") {
+    return {url_route::kind::FILE, {}, "index.html"};
+  }
+  return {url_route::kind::FILE, {}, target.substr(1)};
 }
 
 }  // namespace tiles
@@ -16,6 +16,7 @@ enum perf_task_t : uint32_t {
   GET_TILE_FETCH,
   GET_TILE_RENDER,
   GET_TILE_COMPRESS,
+  GET_TILE_OVERZOOM,
 
   RENDER_TILE_FIND_SEASIDE,
   RENDER_TILE_ADD_SEASIDE,
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tiles/constants.h"
+#include "tiles/perf_counter.h"
+
+namespace tiles {
+
+// Always-on, mergeable alternative to perf_counter + perf_report_get_tile.
+//
+// Every thread records into its own thread_metrics (single writer: relaxed
+// loads/stores, no locks, no contended cache lines). A scrape merges all of
+// them into a Prometheus text exposition.
+
+// Power of two buckets: bucket i counts values < 2^(kFirstBucketLog2 + i),
+// the last one is +Inf. Nanoseconds: ~1us .. ~8.6s, bytes: 1KB .. 8GB.
+struct histogram {
+  static constexpr auto kFirstBucketLog2 = 10U;
+  static constexpr auto kBucketCount = 25U;
+
+  static size_t bucket_idx(uint64_t const value) {
+    auto bits = 0U;  // = bit width
+    for (auto v = value >> kFirstBucketLog2; v != 0; v >>= 1U) {
+      ++bits;
+    }
+    return std::min(bits, kBucketCount - 1);
+  }
+
+  void record(uint64_t const value) {
+    increment(buckets_[bucket_idx(value)], 1);
+    increment(count_, 1);
+    increment(sum_, value);
+  }
+
+  static void increment(std::atomic_uint64_t& a, uint64_t const v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic_uint64_t, kBucketCount> buckets_{};
+  std::atomic_uint64_t count_{0}, sum_{0};
+};
+
+struct zoom_metrics {
+  std::atomic_uint64_t requests_{0}, bytes_{0};
+  histogram latency_;  // nanoseconds until the response is ready
+};
+
+struct thread_metrics {
+  std::array<histogram, perf_task::SIZE> tasks_;
+  std::array<zoom_metrics, kMaxZoomLevel + 1> zoom_;
+};
+
+// perf counter feeding thread_metrics directly (for get_tile et al.)
+struct metrics_perf_counter {
+  using clock_t = std::chrono::steady_clock;
+
+  explicit metrics_perf_counter(thread_metrics& metrics) : metrics_{metrics} {
+    running_.fill(clock_t::time_point::max());
+  }
+
+  template <perf_task::perf_task_t Task>
+  void append(uint64_t const value) {
+    metrics_.tasks_[Task].record(value);
+  }
+
+  template <perf_task::perf_task_t Task>
+  void start() {
+    running_[Task] = clock_t::now();
+  }
+
+  template <perf_task::perf_task_t Task>
+  void stop() {
+    auto& start = running_[Task];
+    if (start == clock_t::time_point::max()) {
+      return;
+    }
+
+    using namespace std::chrono;
+    metrics_.tasks_[Task].record(
+        duration_cast<nanoseconds>(clock_t::now() - start).count());
+    start = clock_t::time_point::max();
+  }
+
+  thread_metrics& metrics_;
+  std::array<clock_t::time_point, perf_task::SIZE> running_;
+};
+
+struct perf_metrics {
+  perf_metrics();
+  ~perf_metrics();
+
+  perf_metrics(perf_metrics const&) = delete;
+  perf_metrics(perf_metrics&&) = delete;
+  perf_metrics& operator=(perf_metrics const&) = delete;
+  perf_metrics& operator=(perf_metrics&&) = delete;
+
+  // the calling thread's slot (registered on first use)
+  thread_metrics& local();
+
+  // results of a classic perf_counter (e.g. when also reporting to stdout)
+  void record(perf_counter const&);
+
+  void record_request(uint32_t z, uint64_t duration_ns, uint64_t bytes);
+
+  // Prometheus text format, all metric names prefixed with "tiles_"
+  std::string to_prometheus() const;
+
+  uint64_t id_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<thread_metrics>> threads_;
+};
+
+}  // namespace tiles
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utl/verify.h"
+
+#include "tiles/cancel_token.h"
+
+namespace tiles {
+
+// Request coalescing: at most one computation per key is in flight.
+//
+// Everybody interested in the result for a key calls join with a callback.
+// The first caller becomes the leader (join returns the flight) and has to
+// compute the value and publish it with finish, which invokes the callbacks
+// of all callers (including the leader) that joined in the meantime.
+//
+// Callers may pass their cancel_token: the computation can be abandoned once
+// all callers are cancelled (see flight::cancel_). It still has to finish.
+// Callers joining after that start a new flight instead of waiting for the
+// abandoned one.
+template <typename Key, typename Value>
+struct single_flight {
+  using callback_t = std::function<void(Value const&)>;
+
+  struct flight {
+    explicit flight(Key key) : key_{std::move(key)} {}
+
+    Key key_;
+    bool finished_{false};  // guarded by single_flight::mutex_
+    std::vector<callback_t> callbacks_;
+    std::shared_ptr<cancel_group> cancel_{std::make_shared<cancel_group>()};
+  };
+  using flight_ptr = std::shared_ptr<flight>;
+
+  // leader: the flight to finish, nullptr: joined a flight in progress
+  flight_ptr join(Key const& key, callback_t callback,
+                  cancel_token* caller = nullptr) {
+    std::lock_guard<std::mutex> l{mutex_};
+    auto& current = waiting_[key];
+    auto const is_leader =
+        current == nullptr || current->cancel_->token_.cancelled();
+    if (is_leader) {
+      // an abandoned flight still finishes (with its own callbacks)
+      current = std::make_shared<flight>(key);
+    } else {
+      ++coalesced_;
+    }
+    current->callbacks_.emplace_back(std::move(callback));
+    current->cancel_->add(caller);
+    return is_leader ? current : nullptr;
+  }
+
+  void finish(flight_ptr const& f, Value const& value) {
+    utl::verify(f != nullptr, "single_flight: finish without flight");
+    std::vector<callback_t> callbacks;
+    {
+      std::lock_guard<std::mutex> l{mutex_};
+      utl::verify(!f->finished_, "single_flight: finished twice");
+      f->finished_ = true;
+      callbacks = std::move(f->callbacks_);
+      if (auto it = waiting_.find(f->key_);
+          it != end(waiting_) && it->second == f) {
+        waiting_.erase(it);
+      }
+    }
+
+    for (auto const& callback : callbacks) {
+      callback(value);
+    }
+  }
+
+  // Drops the callbacks of all flights in progress without invoking them,
+  // e.g. at shutdown when their computations were dropped from a queue.
+  // Finishing such a flight later has no effect.
+  void clear() {
+    std::vector<callback_t> dropped;  // destroyed outside the lock
+    {
+      std::lock_guard<std::mutex> l{mutex_};
+      for (auto& [key, f] : waiting_) {
+        std::move(begin(f->callbacks_), end(f->callbacks_),
+                  std::back_inserter(dropped));
+        f->callbacks_.clear();
+      }
+      waiting_.clear();
+    }
+  }
+
+  size_t in_flight() const {
+    std::lock_guard<std::mutex> l{mutex_};
+    return waiting_.size();
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_map<Key, flight_ptr> waiting_;  // latest flight per key
+  std::atomic_uint64_t coalesced_{0};
+};
+
+}  // namespace tiles
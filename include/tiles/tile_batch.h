@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "geo/latlng.h"
+#include "geo/tile.h"
+
+#include "tiles/bin_utils.h"
+#include "tiles/constants.h"
+#include "tiles/parse_tile_url.h"
+
+namespace tiles {
+
+// Batch requests (e.g. prefetching a corridor along a route).
+//
+// Request body: one entry per line, either a tile "{z}/{x}/{y}" or all tiles
+// of a bounding box on a range of zoom levels
+// "bbox {minlng},{minlat},{maxlng},{maxlat} {minz}[-{maxz}]" (degrees,
+// latitudes beyond the web mercator limit are clamped).
+// Duplicates are removed, the order of first occurrence is kept.
+//
+// Response body: one frame per tile in request order: uint32_t z, x, y and
+// size (little endian) followed by size bytes of tile data as stored in the
+// database (zlib stream). size 0: no tile (empty or fully seaside).
+
+namespace detail {
+
+// web mercator: tiles end at 85.0511287798 (and 180 is on the next tile)
+constexpr auto kBatchMaxLatitude = 85.05112877;
+constexpr auto kBatchMaxLongitude = 179.9999999;
+
+// decimal numbers only (strtod also accepts nan, inf, and hex)
+inline bool consume_double(std::string_view& sv, double& out) {
+  auto const len =
+      std::min(sv.find_first_not_of("0123456789+-.eE"), size_t{32});
+
+  // strtod needs a terminated string
+  std::string const buf{sv.substr(0, len)};
+  char* end = nullptr;
+  out = std::strtod(buf.c_str(), &end);
+  if (end == buf.c_str() || !std::isfinite(out)) {
+    return false;
+  }
+  sv.remove_prefix(static_cast<size_t>(end - buf.c_str()));
+  return true;
+}
+
+inline bool parse_batch_bbox(std::string_view line, size_t const max_tiles,
+                             std::vector<geo::tile>& out,
+                             std::unordered_set<geo::tile>& seen) {
+  double minlng = 0, minlat = 0, maxlng = 0, maxlat = 0;
+  uint32_t minz = 0, maxz = 0;
+  if (!(consume_double(line, minlng) && consume(line, ",") &&
+        consume_double(line, minlat) && consume(line, ",") &&
+        consume_double(line, maxlng) && consume(line, ",") &&
+        consume_double(line, maxlat) && consume(line, " ") &&
+        consume_uint(line, minz))) {
+    return false;
+  }
+  maxz = minz;
+  if (consume(line, "-") && !consume_uint(line, maxz)) {
+    return false;
+  }
+  if (!line.empty() || minz > maxz ||
+      maxz > static_cast<uint32_t>(kMaxZoomLevel) || minlng > maxlng ||
+      minlat > maxlat || minlng < -180 || maxlng > 180 || minlat < -90 ||
+      maxlat > 90) {
+    return false;
+  }
+
+  // e.g. -180,-90,180,90 for the whole world: clamp to the tiled area
+  minlat = std::max(minlat, -kBatchMaxLatitude);
+  maxlat = std::min(maxlat, kBatchMaxLatitude);
+  minlng = std::min(minlng, kBatchMaxLongitude);
+  maxlng = std::min(maxlng, kBatchMaxLongitude);
+
+  for (auto z = minz; z <= maxz; ++z) {
+    for (auto const& tile : geo::make_tile_range({minlat, minlng},
+                                                 {maxlat, maxlng}, z)) {
+      if (seen.insert(tile).second) {
+        if (out.size() == max_tiles) {
+          return false;
+        }
+        out.push_back(tile);
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace detail
+
+// nullopt: malformed or more than max_tiles tiles
+inline std::optional<std::vector<geo::tile>> parse_tile_batch(
+    std::string_view body, size_t const max_tiles) {
+  std::vector<geo::tile> tiles;
+  std::unordered_set<geo::tile> seen;
+  while (!body.empty()) {
+    auto const eol = body.find('\n');
+    auto line = body.substr(0, eol);
+    body.remove_prefix(eol == std::string_view::npos ? body.size() : eol + 1);
+
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.empty()) {
+      continue;
+    }
+
+    if (detail::consume(line, "bbox ")) {
+      if (!detail::parse_batch_bbox(line, max_tiles, tiles, seen)) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    uint32_t x = 0, y = 0, z = 0;
+    if (!(detail::consume_uint(line, z) && detail::consume(line, "/") &&
+          detail::consume_uint(line, x) && detail::consume(line, "/") &&
+          detail::consume_uint(line, y) && line.empty()) ||
+        z > static_cast<uint32_t>(kMaxZoomLevel) || x >= (1U << z) ||
+        y >= (1U << z)) {
+      return std::nullopt;
+    }
+
+    geo::tile const tile{x, y, z};
+    if (seen.insert(tile).second) {
+      if (tiles.size() == max_tiles) {
+        return std::nullopt;
+      }
+      tiles.push_back(tile);
+    }
+  }
+  return tiles;
+}
+
+inline void append_tile_frame(std::string& buf, geo::tile const& tile,
+                              std::string_view const data) {
+  append(buf, static_cast<uint32_t>(tile.z_));
+  append(buf, static_cast<uint32_t>(tile.x_));
+  append(buf, static_cast<uint32_t>(tile.y_));
+  append(buf, static_cast<uint32_t>(data.size()));
+  buf.append(data);
+}
+
+constexpr auto kTileFrameHeaderSize = 4 * sizeof(uint32_t);
+
+// false: truncated input
+template <typename Fn>
+bool for_each_tile_frame(std::string_view buf, Fn&& fn) {
+  while (!buf.empty()) {
+    if (buf.size() < kTileFrameHeaderSize) {
+      return false;
+    }
+    auto const z = read_nth<uint32_t>(buf.data(), 0);
+    auto const x = read_nth<uint32_t>(buf.data(), 1);
+    auto const y = read_nth<uint32_t>(buf.data(), 2);
+    auto const size = read_nth<uint32_t>(buf.data(), 3);
+    buf.remove_prefix(kTileFrameHeaderSize);
+    if (buf.size() < size) {
+      return false;
+    }
+    fn(geo::tile{x, y, z}, buf.substr(0, size));
+    buf.remove_prefix(size);
+  }
+  return true;
+}
+
+}  // namespace tiles
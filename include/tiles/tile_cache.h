@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "tiles/db/tile_index.h"
+#include "tiles/lru_cache.h"
+
+namespace tiles {
+
+// Rendered (compressed) tiles by tile key. An empty string is a valid value
+// (= tile without content).
+using tile_cache = lru_cache<std::string>;
+
+}  // namespace tiles
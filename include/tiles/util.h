@@ -9,6 +9,7 @@
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "fmt/core.h"
@@ -35,6 +36,19 @@ inline void t_log(Args&&... args) {
 
 std::string compress_deflate(std::string const&);
 
+// accepts zlib ("deflate") and gzip streams
+std::string decompress_deflate(std::string_view);
+
+// Rewraps a zlib stream as gzip without recompressing: the deflate data is
+// reused, only crc32 and size of the content have to be computed.
+std::string deflate_to_gzip(std::string_view);
+
+enum class content_encoding { DEFLATE, GZIP, IDENTITY, NOT_ACCEPTABLE };
+
+// Evaluates an Accept-Encoding header (incl. q-values), preferring deflate
+// over gzip over identity on ties. Missing header: identity.
+content_encoding negotiate_content_encoding(std::string_view accept_encoding);
+
 struct progress_tracker {
 #ifdef TILES_GLOBAL_PROGRESS_TRACKER
   progress_tracker() : ptr_{utl::get_active_progress_tracker()} {}
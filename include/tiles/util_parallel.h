@@ -1,14 +1,19 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <iostream>
 #include <mutex>
 #include <optional>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "blockingconcurrentqueue.h"
 
+#include "tiles/util.h"
+
 namespace tiles {
 
 template <typename T>
@@ -180,6 +185,65 @@ struct queue_processor {
   std::vector<std::thread> threads_;
 };
 
+// Fixed set of worker threads with a bounded backlog: try_submit refuses new
+// work (instead of blocking the caller) once max_pending tasks are queued or
+// running. Exceptions of tasks are logged.
+//
+// Destruction waits for running tasks only: tasks still queued are dropped
+// without running (their captures are destroyed with the pool), callers
+// must not rely on every submitted task being run.
+struct bounded_worker_pool {
+  bounded_worker_pool(size_t const thread_count, size_t const max_pending)
+      : max_pending_{max_pending}, pending_{0}, shutdown_{false} {
+    for (auto i = 0ULL; i < thread_count; ++i) {
+      threads_.emplace_back([&, this] {
+        while (!shutdown_) {
+          std::function<void()> fn;
+          if (!queue_.wait_dequeue_timed(fn, std::chrono::milliseconds(10))) {
+            continue;
+          }
+
+          try {
+            fn();
+          } catch (std::exception const& e) {
+            t_log("exception in bounded_worker_pool: {}", e.what());
+          } catch (...) {
+            t_log("unknown exception in bounded_worker_pool");
+          }
+          --pending_;
+        }
+      });
+    }
+  }
+
+  ~bounded_worker_pool() {
+    shutdown_ = true;
+    std::for_each(begin(threads_), end(threads_), [](auto& t) { t.join(); });
+  }
+
+  bounded_worker_pool(bounded_worker_pool const&) = delete;
+  bounded_worker_pool(bounded_worker_pool&&) = delete;
+  bounded_worker_pool& operator=(bounded_worker_pool const&) = delete;
+  bounded_worker_pool& operator=(bounded_worker_pool&&) = delete;
+
+  bool try_submit(std::function<void()> fn) {
+    if (pending_.fetch_add(1) >= max_pending_) {
+      --pending_;
+      return false;
+    }
+    queue_.enqueue(std::move(fn));
+    return true;
+  }
+
+  size_t pending() const { return pending_; }
+
+  size_t max_pending_;
+  std::atomic_size_t pending_;
+  std::atomic_bool shutdown_;
+  moodycamel::BlockingConcurrentQueue<std::function<void()>> queue_;
+  std::vector<std::thread> threads_;
+};
+
 // template <typename Task, uint64_t MaxInFlight = 64>
 // struct throttling_source {
 //   static_assert(MaxInFlight > 0);
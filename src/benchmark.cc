@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <iostream>
 #include <random>
+#include <unordered_set>
 
 #include "conf/configuration.h"
 #include "conf/options_parser.h"
@@ -22,11 +23,14 @@ struct benchmark_settings : public conf::configuration {
           "xyz coords of a single tile, z for all tiles on a certain zoom "
           "level, if not present random smaple");
     param(compress_, "compress", "compress the tiles");
+    param(metatile_, "metatile",
+          "render 2^n x 2^n metatiles (0 = single tiles)");
   }
 
   std::string db_fname_{"tiles.mdb"};
   std::vector<uint32_t> tile_;
   bool compress_{true};
+  uint32_t metatile_{0};
 };
 
 int run_tiles_benchmark(int argc, char const** argv) {
@@ -53,6 +57,23 @@ int run_tiles_benchmark(int argc, char const** argv) {
   tile_db_handle db_handle{db_env};
   pack_handle pack_handle{opt.db_fname_.c_str()};
 
+  auto const render_range = [&](auto const& range, auto&& render_tile) {
+    if (opt.metatile_ == 0) {
+      for (auto const& tile : range) {
+        render_tile(tile);
+      }
+      return;
+    }
+
+    std::unordered_set<geo::tile> roots;
+    for (auto const& tile : range) {
+      if (auto const root = metatile_root(tile, opt.metatile_);
+          roots.insert(root).second) {
+        render_tile(root);
+      }
+    }
+  };
+
   auto render_ctx = make_render_ctx(db_handle);
   render_ctx.ignore_prepared_ = true;
   render_ctx.compress_result_ = opt.compress_;
@@ -76,11 +97,14 @@ int run_tiles_benchmark(int argc, char const** argv) {
       auto features_cursor = lmdb::cursor{txn, features_dbi};
 
       perf_counter pc;
-      for (auto const& tile : geo::make_tile_range(p1, p2, z)) {
-        auto rendered_tile = get_tile(db_handle, txn, features_cursor,
-                                      pack_handle, render_ctx, tile, pc);
-        // break;
-      }
+      render_range(geo::make_tile_range(p1, p2, z), [&](auto const& tile) {
+        if (tile.z_ == static_cast<uint32_t>(z)) {
+          get_tile(db_handle, txn, features_cursor, pack_handle, render_ctx,
+                   tile, pc);
+        } else {
+          get_metatile(features_cursor, pack_handle, render_ctx, tile, z, pc);
+        }
+      });
       perf_report_get_tile(pc);
     }
   } else if (opt.tile_.size() == 1) {
@@ -92,15 +116,19 @@ int run_tiles_benchmark(int argc, char const** argv) {
     auto features_cursor = lmdb::cursor{txn, features_dbi};
 
     perf_counter pc;
-    for (auto const& tile : geo::make_tile_range(z)) {
+    render_range(geo::make_tile_range(z), [&](auto const& tile) {
       try {
-        auto const rendered_tile = get_tile(db_handle, txn, features_cursor,
-                                            pack_handle, render_ctx, tile, pc);
+        if (tile.z_ == z) {
+          get_tile(db_handle, txn, features_cursor, pack_handle, render_ctx,
+                   tile, pc);
+        } else {
+          get_metatile(features_cursor, pack_handle, render_ctx, tile, z, pc);
+        }
       } catch (...) {
         t_log("problem in tile: {}", tile);
         throw;
       }
-    }
+    });
     perf_report_get_tile(pc);
   } else {
     utl::verify(opt.tile_.size() == 3, "need exactly three coordinats: x y z");
@@ -21,6 +21,25 @@
 
 namespace tiles {
 
+std::vector<std::vector<size_t>> prepared_tile_sizes(
+    lmdb::txn& txn, lmdb::txn::dbi& tiles_dbi,
+    uint32_t const max_prepared_zoom_level) {
+  std::vector<std::vector<size_t>> tile_sizes(max_prepared_zoom_level + 1);
+
+  auto tc = lmdb::cursor{txn, tiles_dbi};
+  for (auto el = tc.get<tile_key_t>(lmdb::cursor_op::FIRST); el;
+       el = tc.get<tile_key_t>(lmdb::cursor_op::NEXT)) {
+    if (key_to_n(el->first) != 0) {
+      continue;  // e.g. etag
+    }
+    auto const tile = key_to_tile(el->first);
+    utl::verify(tile.z_ <= max_prepared_zoom_level,
+                "tile outside prepared range found!");
+    tile_sizes.at(tile.z_).emplace_back(el->second.size());
+  }
+  return tile_sizes;
+}
+
 void database_stats(tile_db_handle& db_handle, pack_handle& pack_handle) {
   auto const print_stat = [&](char const* label, auto const& stat) {
     fmt::print(
@@ -116,15 +135,7 @@ void database_stats(tile_db_handle& db_handle, pack_handle& pack_handle) {
   }
 
   uint32_t max_prep = std::stoi(std::string{*opt_max_prep});
-  std::vector<std::vector<size_t>> tile_sizes(max_prep + 1);
-
-  auto tc = lmdb::cursor{txn, tiles_dbi};
-  for (auto el = tc.get<tile_key_t>(lmdb::cursor_op::FIRST); el;
-       el = tc.get<tile_key_t>(lmdb::cursor_op::NEXT)) {
-    auto const tile = key_to_tile(el->first);
-    utl::verify(tile.z_ <= max_prep, "tile outside prepared range found!");
-    tile_sizes.at(tile.z_).emplace_back(el->second.size());
-  }
+  auto tile_sizes = prepared_tile_sizes(txn, tiles_dbi, max_prep);
 
   auto total = std::accumulate(begin(pack_sizes), end(pack_sizes), 0ULL);
   for (auto z = 0ULL; z < tile_sizes.size(); ++z) {
@@ -9,6 +9,7 @@
 
 #include "tiles/db/pack_file.h"
 #include "tiles/db/tile_database.h"
+#include "tiles/db/tile_etag.h"
 #include "tiles/db/tile_index.h"
 #include "tiles/get_tile.h"
 #include "tiles/perf_counter.h"
@@ -16,11 +17,13 @@
 
 namespace tiles {
 
+// all tiles on zoom level z_ below tile_ (a metatile root)
 struct prepare_task {
-  explicit prepare_task(geo::tile tile) : tile_{tile} {}
+  prepare_task(geo::tile tile, uint32_t z) : tile_{tile}, z_{z} {}
   geo::tile tile_;
+  uint32_t z_;
   std::vector<std::pair<geo::tile, pack_record>> packs_;
-  std::optional<std::string> result_;
+  metatile_t results_;
 };
 
 struct prepare_stats {
@@ -32,23 +35,29 @@ struct prepare_stats {
 };
 
 struct prepare_manager {
-  prepare_manager(geo::tile_range base_range, uint32_t max_zoomlevel)
+  prepare_manager(geo::tile_range base_range, uint32_t max_zoomlevel,
+                  uint32_t metatile_levels)
       : max_zoomlevel_{max_zoomlevel},
+        metatile_levels_{metatile_levels},
         curr_zoomlevel_{0},
         base_range_{base_range},
-        curr_range_{geo::tile_range_on_z(base_range_, curr_zoomlevel_)},
+        curr_range_{geo::tile_range_on_z(base_range_, root_zoomlevel())},
         stats_(max_zoomlevel + 1) {
 #ifdef TILES_GLOBAL_PROGRESS_TRACKER
     utl::get_active_progress_tracker()->in_high(max_zoomlevel);
 #endif
   }
 
+  uint32_t root_zoomlevel() const {
+    return curr_zoomlevel_ - std::min(curr_zoomlevel_, metatile_levels_);
+  }
+
   std::vector<prepare_task> get_batch() {
     std::lock_guard<std::mutex> lock{mutex_};
     // do not process all expensive low-z tiles in one thread
     auto const batch_size = 1U << 9U;
     auto const batch_inc = 1U << static_cast<uint32_t>(std::max(
-                               9 - static_cast<int>(curr_zoomlevel_), 0));
+                               9 - static_cast<int>(root_zoomlevel()), 0));
 
     std::vector<prepare_task> batch;
     for (auto i = 0U; i < batch_size; i += batch_inc) {
@@ -56,13 +65,14 @@ struct prepare_manager {
         break;
       }
 
-      ++stats_[curr_zoomlevel_].n_total_;
-      batch.emplace_back(*curr_range_.begin_);
+      stats_[curr_zoomlevel_].n_total_ +=
+          1ULL << (2 * (curr_zoomlevel_ - root_zoomlevel()));
+      batch.emplace_back(*curr_range_.begin_, curr_zoomlevel_);
       ++curr_range_.begin_;
 
       if (curr_range_.begin() == curr_range_.end()) {
         ++curr_zoomlevel_;
-        curr_range_ = geo::tile_range_on_z(base_range_, curr_zoomlevel_);
+        curr_range_ = geo::tile_range_on_z(base_range_, root_zoomlevel());
 
 #ifdef TILES_GLOBAL_PROGRESS_TRACKER
         utl::get_active_progress_tracker()->increment();
@@ -98,13 +108,14 @@ struct prepare_manager {
   }
 
   std::mutex mutex_;
-  std::uint32_t max_zoomlevel_, curr_zoomlevel_;
+  std::uint32_t max_zoomlevel_, metatile_levels_, curr_zoomlevel_;
   geo::tile_range base_range_, curr_range_;
   std::vector<prepare_stats> stats_;
 };
 
 prepare_manager make_prepare_manager(tile_db_handle& db_handle,
-                                     uint32_t max_zoomlevel) {
+                                     uint32_t max_zoomlevel,
+                                     uint32_t metatile_levels) {
   auto minx = std::numeric_limits<uint32_t>::max();
   auto miny = std::numeric_limits<uint32_t>::max();
   auto maxx = std::numeric_limits<uint32_t>::min();
@@ -128,12 +139,12 @@ prepare_manager make_prepare_manager(tile_db_handle& db_handle,
 
   return prepare_manager{
       geo::make_tile_range(minx, miny, maxx, maxy, kTileDefaultIndexZoomLvl),
-      max_zoomlevel};
+      max_zoomlevel, metatile_levels};
 }
 
 void prepare_tiles(tile_db_handle& db_handle, pack_handle& pack_handle,
-                   uint32_t max_zoomlevel) {
-  auto m = make_prepare_manager(db_handle, max_zoomlevel);
+                   uint32_t max_zoomlevel, uint32_t metatile_levels) {
+  auto m = make_prepare_manager(db_handle, max_zoomlevel, metatile_levels);
 
   auto render_ctx = make_render_ctx(db_handle);
   render_ctx.ignore_fully_seaside_ = true;
@@ -166,32 +177,44 @@ void prepare_tiles(tile_db_handle& db_handle, pack_handle& pack_handle,
         for (auto& task : batch) {
           using namespace std::chrono;
           auto start = steady_clock::now();
-          task.result_ = get_tile(
-              render_ctx, task.tile_,
-              [&](auto&& fn) {
-                std::for_each(begin(task.packs_), end(task.packs_),
-                              [&](auto const& p) {
-                                fn(p.first, pack_handle.get(p.second));
-                              });
-              },
-              npc);
+          auto const foreach_pack = [&](auto&& fn) {
+            std::for_each(
+                begin(task.packs_), end(task.packs_),
+                [&](auto const& p) { fn(p.first, pack_handle.get(p.second)); });
+          };
+          if (task.tile_.z_ == task.z_) {
+            task.results_.emplace_back(
+                task.tile_, get_tile(render_ctx, task.tile_, foreach_pack, npc));
+          } else {
+            task.results_ =
+                get_metatile(render_ctx, task.tile_, task.z_, foreach_pack, npc);
+          }
           auto finish = steady_clock::now();
 
-          m.finish(task.tile_, task.result_ ? task.result_->size() : 0,
-                   duration_cast<nanoseconds>(finish - start).count());
+          auto const dur = duration_cast<nanoseconds>(finish - start).count() /
+                           task.results_.size();
+          for (auto const& [tile, result] : task.results_) {
+            m.finish(tile, result ? result->size() : 0, dur);
+          }
         }
 
         {
-          if (std::none_of(begin(batch), end(batch),
-                           [](auto const& t) { return t.result_; })) {
+          auto const has_result = [](auto const& task) {
+            return std::any_of(begin(task.results_), end(task.results_),
+                               [](auto const& r) { return r.second; });
+          };
+          if (std::none_of(begin(batch), end(batch), has_result)) {
             continue;
           }
 
           auto txn = db_handle.make_txn();
           auto tiles_dbi = db_handle.tiles_dbi(txn);
           for (auto& task : batch) {
-            if (task.result_) {
-              txn.put(tiles_dbi, tile_to_key(task.tile_), *task.result_);
+            for (auto const& [tile, result] : task.results_) {
+              if (result) {
+                txn.put(tiles_dbi, tile_to_key(tile), *result);
+                put_prepared_etag(txn, tiles_dbi, tile, *result);
+              }
             }
           }
           txn.commit();
@@ -205,6 +228,7 @@ void prepare_tiles(tile_db_handle& db_handle, pack_handle& pack_handle,
   auto meta_dbi = db_handle.meta_dbi(txn);
   txn.put(meta_dbi, kMetaKeyMaxPreparedZoomLevel,
           std::to_string(max_zoomlevel));
+  put_database_generation(db_handle, txn);
   txn.commit();
 }
 
@@ -1,10 +1,13 @@
 #include "tiles/fixed/algo/clip.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "boost/geometry.hpp"
 
 #include "clipper/clipper.hpp"
 
-#include "utl/erase_if.h"
 #include "utl/verify.h"
 
 #include "tiles/util.h"
@@ -20,8 +23,9 @@ fixed_geometry clip(fixed_null const&, fixed_box const&) {
 fixed_geometry clip(fixed_point const& in, fixed_box const& box) {
   fixed_point out;
 
-  for (auto const& point : in) {
-    if (boost::geometry::within(point, box)) {
+  for (auto const& point : in) {  // strictly inside (like within)
+    if (point.x() > box.min_corner().x() && point.x() < box.max_corner().x() &&
+        point.y() > box.min_corner().y() && point.y() < box.max_corner().y()) {
       out.push_back(point);
     }
   }
@@ -33,11 +37,120 @@ fixed_geometry clip(fixed_point const& in, fixed_box const& box) {
   }
 }
 
+// Cohen-Sutherland outcodes (box boundary is inside)
+constexpr auto const kLeft = 1U;
+constexpr auto const kRight = 2U;
+constexpr auto const kBottom = 4U;
+constexpr auto const kTop = 8U;
+
+inline unsigned get_outcode(fixed_xy const& p, fixed_box const& box) {
+  return (p.x() < box.min_corner().x() ? kLeft : 0U) |
+         (p.x() > box.max_corner().x() ? kRight : 0U) |
+         (p.y() < box.min_corner().y() ? kBottom : 0U) |
+         (p.y() > box.max_corner().y() ? kTop : 0U);
+}
+
+// Liang-Barsky for a segment which is neither trivially in- nor outside.
+// Same arithmetic as boost::geometry (clip_range_with_box): same results as
+// boost::geometry::intersection.
+bool clip_segment(fixed_xy& a, fixed_xy& b, fixed_box const& box,
+                  bool& a_clipped, bool& b_clipped) {
+  double t1 = 0, t2 = 1;
+  auto const check_edge = [&](fixed_coord_t const p, fixed_coord_t const q) {
+    if (p < 0) {
+      auto const r = static_cast<double>(q) / p;
+      if (r > t2) {
+        return false;
+      } else if (r > t1) {
+        t1 = r;
+      }
+    } else if (p > 0) {
+      auto const r = static_cast<double>(q) / p;
+      if (r < t1) {
+        return false;
+      } else if (r < t2) {
+        t2 = r;
+      }
+    } else if (q < 0) {
+      return false;
+    }
+    return true;
+  };
+
+  auto const dx = b.x() - a.x();
+  auto const dy = b.y() - a.y();
+  if (!check_edge(-dx, a.x() - box.min_corner().x()) ||
+      !check_edge(dx, box.max_corner().x() - a.x()) ||
+      !check_edge(-dy, a.y() - box.min_corner().y()) ||
+      !check_edge(dy, box.max_corner().y() - a.y())) {
+    return false;
+  }
+
+  a_clipped = t1 > 0;
+  b_clipped = t2 < 1;
+  if (b_clipped) {
+    b = fixed_xy{static_cast<fixed_coord_t>(a.x() + t2 * dx),
+                 static_cast<fixed_coord_t>(a.y() + t2 * dy)};
+  }
+  if (a_clipped) {
+    a = fixed_xy{static_cast<fixed_coord_t>(a.x() + t1 * dx),
+                 static_cast<fixed_coord_t>(a.y() + t1 * dy)};
+  }
+  return true;
+}
+
+void clip_line(fixed_line const& in, fixed_box const& box,
+               fixed_polyline& out) {
+  fixed_line current;
+  auto const finish = [&] {
+    if (current.size() >= 2) {
+      out.emplace_back(std::move(current));
+    }
+    current.clear();
+  };
+  auto const append = [&](fixed_xy const& a, fixed_xy const& b) {
+    if (current.empty()) {
+      current.push_back(a);
+    }
+    if (!(current.back() == b)) {
+      current.push_back(b);
+    }
+  };
+
+  // most segments are trivially inside (or outside): no intersections
+  auto prev_code = in.empty() ? 0U : get_outcode(in.front(), box);
+  for (auto i = 1ULL; i < in.size(); ++i) {
+    auto const code = get_outcode(in[i], box);
+    if ((prev_code | code) == 0) {
+      append(in[i - 1], in[i]);
+    } else if ((prev_code & code) != 0) {
+      finish();
+    } else {
+      auto a = in[i - 1], b = in[i];
+      auto a_clipped = false, b_clipped = false;
+      if (!clip_segment(a, b, box, a_clipped, b_clipped)) {
+        finish();
+      } else {
+        if (a_clipped) {
+          finish();
+        }
+        append(a, b);
+        if (b_clipped) {
+          finish();
+        }
+      }
+    }
+    prev_code = code;
+  }
+  finish();
+}
+
 fixed_geometry clip(fixed_polyline const& in, fixed_box const& box) {
   fixed_polyline out;
-  boost::geometry::intersection(box, in, out);
+  for (auto const& line : in) {
+    clip_line(line, box, out);
+  }
 
-  utl::erase_if(out, [](auto const& line) { return line.size() < 2; });
   if (out.empty()) {
     return fixed_null{};
   } else {
@@ -73,7 +186,9 @@ void to_fixed_polygon2(fixed_polygon& polygon, cl::PolyNodes const& nodes) {
   }
 }
 
-fixed_geometry clip(fixed_polygon const& in, fixed_box const& box) {
+// general fallback: normalizes arbitrary (self intersecting) polygons
+fixed_geometry clip_with_clipper(fixed_polygon const& in,
+                                 fixed_box const& box) {
   auto const clip = cl::Path{{box.min_corner().x(), box.min_corner().y()},
                              {box.max_corner().x(), box.min_corner().y()},
                              {box.max_corner().x(), box.max_corner().y()},
@@ -113,8 +228,168 @@ fixed_geometry clip(fixed_polygon const& in, fixed_box const& box) {
   return out;
 }
 
+// twice the signed area (only the sign and zero are of interest)
+double signed_area(std::vector<fixed_xy> const& ring) {
+  auto area = 0.0;
+  for (auto i = 1ULL; i + 1 < ring.size(); ++i) {
+    auto const& o = ring.front();
+    area += static_cast<double>(ring[i].x() - o.x()) *
+                static_cast<double>(ring[i + 1].y() - o.y()) -
+            static_cast<double>(ring[i + 1].x() - o.x()) *
+                static_cast<double>(ring[i].y() - o.y());
+  }
+  return area;
+}
+
+// intersection with the line x = x (a and b on different sides of it)
+fixed_xy intersect_x(fixed_xy a, fixed_xy b, fixed_coord_t const x) {
+  if (b.x() < a.x()) {
+    std::swap(a, b);  // same point for both directions (shared edges)
+  }
+  auto const t = static_cast<double>(x - a.x()) / (b.x() - a.x());
+  return {x, a.y() + std::llround(t * static_cast<double>(b.y() - a.y()))};
+}
+
+// intersection with the line y = y (a and b on different sides of it)
+fixed_xy intersect_y(fixed_xy a, fixed_xy b, fixed_coord_t const y) {
+  if (b.y() < a.y()) {
+    std::swap(a, b);
+  }
+  auto const t = static_cast<double>(y - a.y()) / (b.y() - a.y());
+  return {a.x() + std::llround(t * static_cast<double>(b.x() - a.x())), y};
+}
+
+// one Sutherland-Hodgman step: keeps the side of the (open) ring where
+// inside(pt) holds, crossing edges are cut with intersect(a, b)
+template <typename Inside, typename Intersect>
+void clip_ring_edge(std::vector<fixed_xy> const& in, std::vector<fixed_xy>& out,
+                    Inside&& inside, Intersect&& intersect) {
+  out.clear();
+  if (in.empty()) {
+    return;
+  }
+
+  auto const* prev = &in.back();
+  auto prev_inside = inside(*prev);
+  for (auto const& curr : in) {
+    auto const curr_inside = inside(curr);
+    if (curr_inside != prev_inside) {
+      out.push_back(intersect(*prev, curr));
+    }
+    if (curr_inside) {
+      out.push_back(curr);
+    }
+    prev = &curr;
+    prev_inside = curr_inside;
+  }
+}
+
+enum class ring_clip_result { kEmpty, kRing, kUnsupported };
+
+ring_clip_result clip_ring(fixed_ring const& in, fixed_box const& box,
+                           fixed_ring& out, std::vector<fixed_xy>& buf) {
+  auto const& min = box.min_corner();
+  auto const& max = box.max_corner();
+
+  // trivial cases first (most rings are far inside or outside)
+  auto min_x = std::numeric_limits<fixed_coord_t>::max();
+  auto min_y = std::numeric_limits<fixed_coord_t>::max();
+  auto max_x = std::numeric_limits<fixed_coord_t>::min();
+  auto max_y = std::numeric_limits<fixed_coord_t>::min();
+  for (auto const& p : in) {  // plain min/max reduction: vectorizes
+    min_x = std::min(min_x, p.x());
+    max_x = std::max(max_x, p.x());
+    min_y = std::min(min_y, p.y());
+    max_y = std::max(max_y, p.y());
+  }
+  if (max_x < min.x() || min_x > max.x() || max_y < min.y() ||
+      min_y > max.y()) {
+    return ring_clip_result::kEmpty;
+  }
+  if (min_x >= min.x() && min_y >= min.y() && max_x <= max.x() &&
+      max_y <= max.y()) {
+    out = in;
+    return ring_clip_result::kRing;
+  }
+
+  out.assign(begin(in), end(in));
+  if (!out.empty() && out.front() == out.back()) {
+    out.pop_back();  // open ring
+  }
+  auto const input_area = signed_area(out);
+
+  clip_ring_edge(
+      out, buf, [&](auto const& p) { return p.x() >= min.x(); },
+      [&](auto const& a, auto const& b) { return intersect_x(a, b, min.x()); });
+  clip_ring_edge(
+      buf, out, [&](auto const& p) { return p.x() <= max.x(); },
+      [&](auto const& a, auto const& b) { return intersect_x(a, b, max.x()); });
+  clip_ring_edge(
+      out, buf, [&](auto const& p) { return p.y() >= min.y(); },
+      [&](auto const& a, auto const& b) { return intersect_y(a, b, min.y()); });
+  clip_ring_edge(
+      buf, out, [&](auto const& p) { return p.y() <= max.y(); },
+      [&](auto const& a, auto const& b) { return intersect_y(a, b, max.y()); });
+
+  out.erase(std::unique(begin(out), end(out)), end(out));
+  while (out.size() > 1 && out.front() == out.back()) {
+    out.pop_back();
+  }
+
+  auto const output_area = signed_area(out);
+  if (out.size() < 3 || output_area == 0) {
+    return ring_clip_result::kEmpty;  // degenerate: area collapsed
+  }
+  if ((input_area < 0) != (output_area < 0)) {
+    return ring_clip_result::kUnsupported;  // input is not a simple ring
+  }
+
+  out.push_back(out.front());
+  return ring_clip_result::kRing;
+}
+
+// Sutherland-Hodgman per ring: parts of concave polygons outside the box
+// collapse into zero width edges along the box (within the overdraw).
+fixed_geometry clip(fixed_polygon const& in, fixed_box const& box) {
+  fixed_polygon out;
+  std::vector<fixed_xy> buf;
+  for (auto const& polygon : in) {
+    fixed_simple_polygon clipped;
+    auto result = clip_ring(polygon.outer(), box, clipped.outer(), buf);
+    if (result == ring_clip_result::kUnsupported) {
+      return clip_with_clipper(in, box);
+    } else if (result == ring_clip_result::kEmpty) {
+      continue;
+    }
+
+    for (auto const& inner : polygon.inners()) {
+      fixed_ring ring;
+      result = clip_ring(inner, box, ring, buf);
+      if (result == ring_clip_result::kUnsupported) {
+        return clip_with_clipper(in, box);
+      } else if (result == ring_clip_result::kRing) {
+        clipped.inners().emplace_back(std::move(ring));
+      }
+    }
+    out.emplace_back(std::move(clipped));
+  }
+
+  if (out.empty()) {
+    return fixed_null{};
+  }
+
+  boost::geometry::correct(out);  // orientation like from clip_with_clipper
+  return out;
+}
+
 fixed_geometry clip(fixed_geometry const& in, fixed_box const& box) {
   return mpark::visit([&](auto const& arg) { return clip(arg, box); }, in);
 }
 
+void correct_orientation(fixed_geometry& geometry) {
+  if (mpark::holds_alternative<fixed_polygon>(geometry)) {
+    boost::geometry::correct(mpark::get<fixed_polygon>(geometry));
+  }
+}
+
 }  // namespace tiles
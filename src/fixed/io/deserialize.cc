@@ -118,7 +118,7 @@ fixed_polyline deserialize_polyline(Decoder&& decoder) {
 }
 
 template <typename Decoder>
-fixed_geometry deserialize_polygon(Decoder&& decoder) {
+fixed_polygon read_polygon(Decoder&& decoder) {
   auto const count = decoder.get_next();
 
   fixed_polygon polygon;
@@ -132,7 +132,10 @@ fixed_geometry deserialize_polygon(Decoder&& decoder) {
       decoder.deserialize_points(polygon[i].inners()[j]);
     }
   }
+  return polygon;
+}
 
+fixed_geometry finish_polygon(fixed_polygon polygon) {
   utl::erase_if(polygon, [](auto& p) {
     utl::erase_if(p.inners(), [](auto const& i) { return i.size() < 4; });
     return p.outer().size() < 4;
@@ -145,6 +148,11 @@ fixed_geometry deserialize_polygon(Decoder&& decoder) {
   }
 }
 
+template <typename Decoder>
+fixed_geometry deserialize_polygon(Decoder&& decoder) {
+  return finish_polygon(read_polygon(decoder));
+}
+
 fixed_geometry deserialize(std::string_view geo) {
   pz::pbf_message<tags::fixed_geometry> m{geo};
   utl::verify(m.next(), "invalid msg");
@@ -183,4 +191,88 @@ fixed_geometry deserialize(std::string_view geo,
   }
 }
 
+tags::fixed_geometry_type geometry_type(std::string_view geo) {
+  pz::pbf_message<tags::fixed_geometry> m{geo};
+  utl::verify(m.next(), "invalid msg");
+  utl::verify(m.tag() == tags::fixed_geometry::required_fixed_geometry_type,
+              "invalid tag");
+  return static_cast<tags::fixed_geometry_type>(m.get_enum());
+}
+
+fixed_geometry deserialize_unsimplified(std::string_view geo) {
+  pz::pbf_message<tags::fixed_geometry> m{geo};
+  utl::verify(m.next(), "invalid msg");
+  utl::verify(m.tag() == tags::fixed_geometry::required_fixed_geometry_type,
+              "invalid tag");
+
+  switch (static_cast<tags::fixed_geometry_type>(m.get_enum())) {
+    case tags::fixed_geometry_type::POINT:
+      return deserialize_point(make_default_decoder(m));
+    case tags::fixed_geometry_type::POLYLINE:
+      return deserialize_polyline(make_default_decoder(m));
+    case tags::fixed_geometry_type::POLYGON:
+      return read_polygon(make_default_decoder(m));
+    default: throw utl::fail("unknown geometry");
+  }
+}
+
+struct mask_applier {
+  template <typename Container>
+  Container apply(Container const& in) {
+    if (simplify_masks_.empty()) {
+      return in;
+    }
+
+    utl::verify(curr_mask_ < simplify_masks_.size(), "mask part missing");
+    geo::simplify_mask_reader reader{simplify_masks_[curr_mask_++].data(), z_};
+    utl::verify(static_cast<size_t>(reader.size_) == in.size(),
+                "simplify mask size mismatch");
+
+    Container out;
+    out.reserve(in.size());
+    for (auto i = 0ULL; i < in.size(); ++i) {
+      if (reader.get_bit(i)) {
+        out.push_back(in[i]);
+      }
+    }
+    return out;
+  }
+
+  fixed_geometry operator()(fixed_null const&) { return fixed_null{}; }
+
+  fixed_geometry operator()(fixed_point const& point) { return point; }
+
+  fixed_geometry operator()(fixed_polyline const& polyline) {
+    fixed_polyline out;
+    out.reserve(polyline.size());
+    for (auto const& line : polyline) {
+      out.push_back(apply(line));
+    }
+    return out;
+  }
+
+  fixed_geometry operator()(fixed_polygon const& polygon) {
+    fixed_polygon out;
+    out.resize(polygon.size());
+    for (auto i = 0ULL; i < polygon.size(); ++i) {
+      out[i].outer() = apply(polygon[i].outer());
+      out[i].inners().reserve(polygon[i].inners().size());
+      for (auto const& inner : polygon[i].inners()) {
+        out[i].inners().push_back(apply(inner));
+      }
+    }
+    return finish_polygon(std::move(out));
+  }
+
+  std::vector<std::string_view> const& simplify_masks_;
+  uint32_t z_;
+  size_t curr_mask_{0};
+};
+
+fixed_geometry apply_simplify_masks(
+    fixed_geometry const& unsimplified,
+    std::vector<std::string_view> const& simplify_masks, uint32_t const z) {
+  return mpark::visit(mask_applier{simplify_masks, z}, unsimplified);
+}
+
 }  // namespace tiles
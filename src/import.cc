@@ -26,6 +26,8 @@ struct import_settings : public conf::configuration {
     param(tasks_, "tasks",
           "'all' or any combination of: 'coastlines', "
           "'features', 'stats', 'pack', 'tiles'");
+    param(metatile_levels_, "metatile_levels",
+          "tiles: render 2^n x 2^n tiles at once (0 = single tiles)");
   }
 
   bool has_any_task(std::vector<std::string> const& query) const {
@@ -41,6 +43,7 @@ struct import_settings : public conf::configuration {
   std::string coastlines_fname_{"land-polygons-complete-4326.zip"};
   std::string tmp_dname_{"."};
   std::vector<std::string> tasks_{{"all"}};
+  uint32_t metatile_levels_{1};
 };
 
 int run_tiles_import(int argc, char const** argv) {
@@ -104,7 +107,7 @@ int run_tiles_import(int argc, char const** argv) {
 
   if (opt.has_any_task({"tiles"})) {
     t_log("prepare tiles");
-    prepare_tiles(db_handle, pack_handle, 10);
+    prepare_tiles(db_handle, pack_handle, 10, opt.metatile_levels_);
   }
 
   t_log("import done!");
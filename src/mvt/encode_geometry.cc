@@ -4,7 +4,12 @@
 
 #include "boost/geometry.hpp"
 
+#include "protozero/pbf_message.hpp"
+
+#include "geo/simplify_mask.h"
+
 #include "tiles/fixed/algo/delta.h"
+#include "tiles/fixed/io/tags.h"
 #include "tiles/mvt/tags.h"
 #include "tiles/util.h"
 
@@ -108,4 +113,155 @@ void encode_geometry(pz::pbf_builder<ttm::Feature>& pb,
   mpark::visit([&](auto const& arg) { encode(pb, arg, spec); }, geometry);
 }
 
+struct transcoder {
+  using range_t =
+      pz::iterator_range<pz::pbf_reader::const_sint64_iterator>;
+
+  transcoder(range_t range, tile_spec const& spec, std::vector<uint32_t>& buf)
+      : range_{std::move(range)},
+        delta_z_{kMaxZoomLevel - spec.tile_.z_},
+        x_enc_{static_cast<fixed_coord_t>(spec.px_bounds_.min_corner().x())},
+        y_enc_{static_cast<fixed_coord_t>(spec.px_bounds_.min_corner().y())},
+        buf_{buf} {
+    buf_.clear();
+  }
+
+  fixed_delta_t get_next() {
+    utl::verify(range_.first != range_.second, "iterator problem");
+    auto val = *range_.first;
+    ++range_.first;
+    return val;
+  }
+
+  // decodes always (delta chain), shifted like shift(fixed_xy&, z)
+  fixed_xy next_point() {
+    // do not inline -> undefined execution order
+    auto const x = x_dec_.decode(get_next());
+    auto const y = y_dec_.decode(get_next());
+    return {x >> delta_z_, y >> delta_z_};
+  }
+
+  void add_point(fixed_xy const& p) {
+    buf_.push_back(encode_zigzag32(x_enc_.encode(p.x())));
+    buf_.push_back(encode_zigzag32(y_enc_.encode(p.y())));
+  }
+
+  // like shift + encode: consecutive duplicates (after shifting) are dropped
+  bool transcode_point() {
+    auto const count = get_next();
+    buf_.push_back(0U);  // command, count known at the end
+
+    auto added = 0U;
+    fixed_xy last;
+    for (auto i = 0LL; i < count; ++i) {
+      auto const p = next_point();
+      if (added != 0 && p == last) {
+        continue;
+      }
+      add_point(p);
+      last = p;
+      ++added;
+    }
+
+    buf_.front() = encode_command(MOVE_TO, added);
+    return added != 0;
+  }
+
+  // like simplify + shift + encode_path<false>: lines with less than two
+  // (distinct) points are dropped without touching the encoder state
+  bool transcode_polyline(std::vector<std::string_view> const& simplify_masks,
+                          uint32_t const z) {
+    auto const count = get_next();
+    for (auto i = 0LL; i < count; ++i) {
+      auto const size = get_next();
+
+      std::optional<geo::simplify_mask_reader> mask;
+      if (!simplify_masks.empty()) {
+        utl::verify(static_cast<size_t>(i) < simplify_masks.size(),
+                    "mask part missing");
+        mask.emplace(simplify_masks[i].data(), z);
+        utl::verify(size == mask->size_, "simplify mask size mismatch");
+      }
+
+      auto const start = buf_.size();
+      auto const x_enc = x_enc_;
+      auto const y_enc = y_enc_;
+
+      auto added = 0U;
+      fixed_xy last;
+      for (auto j = 0LL; j < size; ++j) {
+        auto const p = next_point();
+        if ((mask && !mask->get_bit(j)) || (added != 0 && p == last)) {
+          continue;
+        }
+
+        if (added == 0) {
+          buf_.push_back(encode_command(MOVE_TO, 1));
+          add_point(p);
+          buf_.push_back(0U);  // LINE_TO, count known at the end
+        } else {
+          add_point(p);
+        }
+        last = p;
+        ++added;
+      }
+
+      if (added < 2) {
+        buf_.resize(start);
+        x_enc_ = x_enc;
+        y_enc_ = y_enc;
+      } else {
+        buf_[start + 3] = encode_command(LINE_TO, added - 1);
+      }
+    }
+    return !buf_.empty();
+  }
+
+  range_t range_;
+  uint32_t delta_z_;
+
+  delta_decoder x_dec_{kFixedCoordMagicOffset};
+  delta_decoder y_dec_{kFixedCoordMagicOffset};
+  delta_encoder x_enc_, y_enc_;
+
+  std::vector<uint32_t>& buf_;
+};
+
+bool transcode_geometry(pz::pbf_builder<ttm::Feature>& pb,
+                        std::string_view geo,
+                        std::vector<std::string_view> const& simplify_masks,
+                        tile_spec const& spec, std::vector<uint32_t>& buf) {
+  pz::pbf_message<tags::fixed_geometry> m{geo};
+  utl::verify(m.next(), "invalid msg");
+  utl::verify(m.tag() == tags::fixed_geometry::required_fixed_geometry_type,
+              "invalid tag");
+  auto const type = static_cast<tags::fixed_geometry_type>(m.get_enum());
+
+  utl::verify(m.next(), "invalid message");
+  utl::verify(m.tag() == tags::fixed_geometry::packed_sint64_geometry,
+              "invalid tag");
+  transcoder t{m.get_packed_sint64(), spec, buf};
+
+  switch (type) {
+    case tags::fixed_geometry_type::POINT:
+      if (!t.transcode_point()) {
+        return false;
+      }
+      pb.add_enum(ttm::Feature::optional_GeomType_type, ttm::GeomType::POINT);
+      break;
+    case tags::fixed_geometry_type::POLYLINE:
+      if (!t.transcode_polyline(simplify_masks, spec.tile_.z_)) {
+        return false;
+      }
+      pb.add_enum(ttm::Feature::optional_GeomType_type,
+                  ttm::GeomType::LINESTRING);
+      break;
+    default: throw utl::fail("transcode_geometry: unsupported geometry");
+  }
+
+  pb.add_packed_uint32(ttm::Feature::packed_uint32_geometry, begin(buf),
+                       end(buf));
+  return true;
+}
+
 }  // namespace tiles
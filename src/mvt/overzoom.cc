@@ -0,0 +1,213 @@
+#include "tiles/mvt/overzoom.h"
+
+#include "boost/geometry.hpp"
+
+#include "protozero/pbf_builder.hpp"
+#include "protozero/pbf_message.hpp"
+
+#include "utl/verify.h"
+
+#include "tiles/fixed/algo/clip.h"
+#include "tiles/fixed/algo/shift.h"
+#include "tiles/mvt/encode_geometry.h"
+#include "tiles/mvt/tags.h"
+#include "tiles/mvt/tile_spec.h"
+
+namespace pz = protozero;
+namespace ttm = tiles::tags::mvt;
+
+namespace tiles {
+
+namespace {
+
+enum decode_command : uint32_t { MOVE_TO = 1, LINE_TO = 2, CLOSE_PATH = 7 };
+
+struct geometry_decoder {
+  explicit geometry_decoder(geo::tile const& ancestor)
+      : origin_{tile_spec{ancestor}.px_bounds_.min_corner()},
+        delta_z_{static_cast<uint32_t>(kFixedDefaultZoomLevel) - ancestor.z_} {}
+
+  // into absolute z20 coordinates, like geometries from the database
+  template <typename Range>
+  fixed_geometry decode(int const type, Range range) const {
+    fixed_point points;
+    fixed_polyline paths;
+
+    auto const next = [&] {
+      utl::verify(!range.empty(), "overzoom: geometry truncated");
+      return *(range.first++);
+    };
+
+    fixed_coord_t x = 0, y = 0;
+    auto const next_xy = [&] {
+      x += pz::decode_zigzag32(next());
+      y += pz::decode_zigzag32(next());
+      return fixed_xy{(origin_.x() + x) << delta_z_,
+                      (origin_.y() + y) << delta_z_};
+    };
+
+    while (!range.empty()) {
+      auto const cmd = next();
+      auto const count = cmd >> 3U;
+      switch (cmd & 0x7U) {
+        case MOVE_TO:
+          for (auto i = 0U; i < count; ++i) {
+            if (type == ttm::GeomType::POINT) {
+              points.push_back(next_xy());
+            } else {
+              paths.emplace_back().push_back(next_xy());
+            }
+          }
+          break;
+        case LINE_TO:
+          utl::verify(!paths.empty(), "overzoom: LINE_TO without MOVE_TO");
+          for (auto i = 0U; i < count; ++i) {
+            paths.back().push_back(next_xy());
+          }
+          break;
+        case CLOSE_PATH:
+          utl::verify(!paths.empty(), "overzoom: CLOSE_PATH without MOVE_TO");
+          paths.back().push_back(paths.back().front());
+          break;
+        default: throw utl::fail("overzoom: unknown geometry command");
+      }
+    }
+
+    switch (type) {
+      case ttm::GeomType::POINT: return points;
+      case ttm::GeomType::LINESTRING: return paths;
+      case ttm::GeomType::POLYGON: {
+        // exterior rings have the orientation of corrected polygons
+        fixed_polygon polygons;
+        for (auto& path : paths) {
+          fixed_ring ring{begin(path), end(path)};
+          if (polygons.empty() || boost::geometry::area(ring) > 0) {
+            polygons.emplace_back().outer() = std::move(ring);
+          } else {
+            polygons.back().inners().emplace_back(std::move(ring));
+          }
+        }
+        return polygons;
+      }
+      default: return fixed_null{};
+    }
+  }
+
+  fixed_xy origin_;
+  uint32_t delta_z_;
+};
+
+// empty: no feature left
+std::string overzoom_feature(std::string_view const feature,
+                             geometry_decoder const& decoder,
+                             tile_spec const& spec) {
+  std::optional<uint64_t> id;
+  std::string_view tags;
+  pz::iterator_range<pz::pbf_reader::const_uint32_iterator> geometry_data;
+  int type = ttm::GeomType::UNKNOWN;
+
+  pz::pbf_message<ttm::Feature> msg{feature.data(), feature.size()};
+  while (msg.next()) {
+    switch (msg.tag()) {
+      case ttm::Feature::optional_uint64_id: id = msg.get_uint64(); break;
+      case ttm::Feature::packed_uint32_tags: {
+        auto const view = msg.get_view();
+        tags = {view.data(), view.size()};
+      } break;
+      case ttm::Feature::optional_GeomType_type: type = msg.get_enum(); break;
+      case ttm::Feature::packed_uint32_geometry:
+        geometry_data = msg.get_packed_uint32();
+        break;
+      default: msg.skip();
+    }
+  }
+
+  auto geometry = decoder.decode(type, geometry_data);
+  geometry = clip(geometry, spec.draw_bounds_);
+  geometry = shift(geometry, spec.tile_.z_);
+  if (mpark::holds_alternative<fixed_null>(geometry)) {
+    return {};
+  }
+
+  std::string buf;
+  pz::pbf_builder<ttm::Feature> pb{buf};
+  encode_geometry(pb, geometry, spec);
+  if (id) {
+    pb.add_uint64(ttm::Feature::optional_uint64_id, *id);
+  }
+  if (!tags.empty()) {  // packed: the payload can be copied as is
+    pb.add_bytes(ttm::Feature::packed_uint32_tags, tags.data(), tags.size());
+  }
+  return buf;
+}
+
+// empty: no feature left
+std::string overzoom_layer(std::string_view const layer,
+                           geometry_decoder const& decoder,
+                           tile_spec const& spec) {
+  std::string buf;
+  pz::pbf_builder<ttm::Layer> pb{buf};
+  auto has_features = false;
+
+  pz::pbf_message<ttm::Layer> msg{layer.data(), layer.size()};
+  while (msg.next()) {
+    switch (msg.tag()) {
+      case ttm::Layer::required_uint32_version:
+        pb.add_uint32(ttm::Layer::required_uint32_version, msg.get_uint32());
+        break;
+      case ttm::Layer::optional_uint32_extent: {
+        auto const extent = msg.get_uint32();
+        utl::verify(extent == kTileSize, "overzoom: unsupported extent {}",
+                    extent);
+        pb.add_uint32(ttm::Layer::optional_uint32_extent, extent);
+      } break;
+      case ttm::Layer::repeated_Feature_features: {
+        auto const view = msg.get_view();
+        auto const feature = overzoom_feature({view.data(), view.size()},
+                                              decoder, spec);
+        if (!feature.empty()) {
+          pb.add_message(ttm::Layer::repeated_Feature_features, feature);
+          has_features = true;
+        }
+      } break;
+      case ttm::Layer::required_string_name:
+      case ttm::Layer::repeated_string_keys:
+      case ttm::Layer::repeated_Value_values: {  // tags stay valid
+        auto const tag = msg.tag();
+        auto const view = msg.get_view();
+        pb.add_bytes(tag, view.data(), view.size());
+      } break;
+      default: msg.skip();
+    }
+  }
+
+  return has_features ? buf : std::string{};
+}
+
+}  // namespace
+
+std::string overzoom_tile(std::string_view const ancestor_mvt,
+                          geo::tile const& ancestor, geo::tile const& tile) {
+  utl::verify(ancestor.z_ <= tile.z_ &&
+                  (tile.x_ >> (tile.z_ - ancestor.z_)) == ancestor.x_ &&
+                  (tile.y_ >> (tile.z_ - ancestor.z_)) == ancestor.y_,
+              "overzoom: {} is no ancestor of {}", ancestor, tile);
+
+  geometry_decoder const decoder{ancestor};
+  tile_spec const spec{tile};
+
+  std::string buf;
+  pz::pbf_builder<ttm::Tile> pb{buf};
+
+  pz::pbf_message<ttm::Tile> msg{ancestor_mvt.data(), ancestor_mvt.size()};
+  while (msg.next(ttm::Tile::repeated_Layer_layers)) {
+    auto const view = msg.get_view();
+    auto const layer = overzoom_layer({view.data(), view.size()}, decoder, spec);
+    if (!layer.empty()) {
+      pb.add_message(ttm::Tile::repeated_Layer_layers, layer);
+    }
+  }
+  return buf;
+}
+
+}  // namespace tiles
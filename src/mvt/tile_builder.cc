@@ -7,8 +7,8 @@
 #include "boost/algorithm/string/predicate.hpp"
 
 #include "utl/get_or_create.h"
-#include "utl/get_or_create_index.h"
 
+#include "tiles/arena.h"
 #include "tiles/bin_utils.h"
 #include "tiles/feature/aggregate_line_features.h"
 #include "tiles/feature/aggregate_polygon_features.h"
@@ -33,26 +33,63 @@ constexpr auto const kScreenPixelArea =
     (kVectorTileExtend / kRasterTileExtend) *
     (kVectorTileExtend / kRasterTileExtend);
 
+tags::fixed_geometry_type geometry_type(fixed_geometry const& geometry) {
+  if (mpark::holds_alternative<fixed_point>(geometry)) {
+    return tags::fixed_geometry_type::POINT;
+  } else if (mpark::holds_alternative<fixed_polyline>(geometry)) {
+    return tags::fixed_geometry_type::POLYLINE;
+  } else if (mpark::holds_alternative<fixed_polygon>(geometry)) {
+    return tags::fixed_geometry_type::POLYGON;
+  } else {
+    return tags::fixed_geometry_type::UNKNOWN;
+  }
+}
+
+// containers live in the arena of the tile_builder (freed all at once)
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+using arena_id_set =
+    std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<>,
+                       arena_allocator<uint64_t>>;
+using arena_index_map =
+    std::map<std::string_view, size_t, std::less<>,
+             arena_allocator<std::pair<std::string_view const, size_t>>>;
+
 struct layer_builder {
-  layer_builder(render_ctx const& ctx, std::string layer_name,
+  layer_builder(render_ctx const& ctx, arena& arena, std::string layer_name,
                 tile_spec const& spec)
       : ctx_{ctx},
+        arena_{arena},
         layer_name_{std::move(layer_name)},
         spec_{spec},
         has_geometry_{false},
-        pb_{buf_} {
+        pb_{buf_},
+        tags_{arena_allocator<uint32_t>{arena}},
+        meta_key_cache_{arena_allocator<arena_index_map::value_type>{arena}},
+        meta_value_cache_{arena_allocator<arena_index_map::value_type>{arena}},
+        node_ids_{arena_allocator<uint64_t>{arena}},
+        line_ids_{arena_allocator<uint64_t>{arena}},
+        poly_ids_{arena_allocator<uint64_t>{arena}} {
     pb_.add_uint32(ttm::Layer::required_uint32_version, 2);
     pb_.add_string(ttm::Layer::required_string_name, layer_name_);
     pb_.add_uint32(ttm::Layer::optional_uint32_extent, kVectorTileExtend);
   }
 
-  void add_feature(feature f) {
-    if ((mpark::holds_alternative<fixed_point>(f.geometry_) &&
-         !node_ids_.insert(f.id_).second) ||
-        (mpark::holds_alternative<fixed_polyline>(f.geometry_) &&
-         !line_ids_.insert(f.id_).second) ||
-        (mpark::holds_alternative<fixed_polygon>(f.geometry_) &&
-         !poly_ids_.insert(f.id_).second)) {
+  // false: already added (from another pack or quad tree node)
+  bool insert_id(tags::fixed_geometry_type const type, uint64_t const id) {
+    switch (type) {
+      case tags::fixed_geometry_type::POINT: return node_ids_.insert(id).second;
+      case tags::fixed_geometry_type::POLYLINE:
+        return line_ids_.insert(id).second;
+      case tags::fixed_geometry_type::POLYGON:
+        return poly_ids_.insert(id).second;
+      default: return true;
+    }
+  }
+
+  // contained: bbox of the geometry strictly inside the draw bounds
+  void add_feature(feature f, bool const contained) {
+    if (!insert_id(geometry_type(f.geometry_), f.id_)) {
       return;
     }
 
@@ -63,49 +100,90 @@ struct layer_builder {
 
     if (ctx_.tb_aggregate_lines_ &&
         mpark::holds_alternative<fixed_polyline>(f.geometry_)) {
+      lines_contained_ = lines_contained_ && contained;
       line_buffer_.emplace_back(std::move(f));
     } else if (ctx_.tb_aggregate_polygons_ &&
                mpark::holds_alternative<fixed_polygon>(f.geometry_)) {
-      polygon_buffer_.emplace_back(std::move(f));
+      polygon_buffer_.emplace_back(std::move(f), contained);
     } else {
-      f.geometry_ = clip(f.geometry_, spec_.draw_bounds_);
+      clip_to_draw_bounds(f.geometry_, contained);
       f.geometry_ = shift(f.geometry_, spec_.tile_.z_);
       write_feature(f);
     }
   }
 
+  void clip_to_draw_bounds(fixed_geometry& geometry,
+                           bool const contained) const {
+    if (contained) {
+      correct_orientation(geometry);
+    } else {
+      geometry = clip(geometry, spec_.draw_bounds_);
+    }
+  }
+
+  void add_feature(feature const& f, std::string_view const geometry,
+                   std::vector<std::string_view> const& simplify_masks) {
+    if (!insert_id(tiles::geometry_type(geometry), f.id_)) {
+      return;
+    }
+
+    ++features_added_;
+
+    feature_buf_.clear();  // keeps the capacity for the next feature
+    pbf_builder<ttm::Feature> feature_pb(feature_buf_);
+    if (transcode_geometry(feature_pb, geometry, simplify_masks, spec_,
+                           commands_)) {
+      finish_feature(feature_pb, f);
+    }
+  }
+
   void write_feature(feature const& f) {
     if (mpark::holds_alternative<fixed_null>(f.geometry_)) {
       return;
     }
 
+    feature_buf_.clear();  // keeps the capacity for the next feature
+    pbf_builder<ttm::Feature> feature_pb(feature_buf_);
+    encode_geometry(feature_pb, f.geometry_, spec_);
+    finish_feature(feature_pb, f);
+  }
+
+  // geometry is already written
+  void finish_feature(pbf_builder<ttm::Feature>& feature_pb,
+                      feature const& f) {
     has_geometry_ = true;
     ++features_written_;
 
-    std::string feature_buf;
-    pbf_builder<ttm::Feature> feature_pb(feature_buf);
-
-    encode_geometry(feature_pb, f.geometry_, spec_);
-
     feature_pb.add_uint64(ttm::Feature::optional_uint64_id, f.id_);
     write_metadata(feature_pb, f.meta_);
-    pb_.add_message(ttm::Layer::repeated_Feature_features, feature_buf);
+    pb_.add_message(ttm::Layer::repeated_Feature_features, feature_buf_);
   }
 
   void write_metadata(pbf_builder<ttm::Feature>& pb,
                       std::vector<metadata> const& meta) {
-    std::vector<uint32_t> t;
-
+    tags_.clear();
     for (auto const& m : meta) {
       if (m.key_ == "layer" || boost::starts_with(m.key_, "__")) {
         continue;
       }
 
-      t.emplace_back(utl::get_or_create_index(meta_key_cache_, m.key_));
-      t.emplace_back(utl::get_or_create_index(meta_value_cache_, m.value_));
+      tags_.emplace_back(get_or_create_index(meta_key_cache_, m.key_));
+      tags_.emplace_back(get_or_create_index(meta_value_cache_, m.value_));
     }
 
-    pb.add_packed_uint32(ttm::Feature::packed_uint32_tags, begin(t), end(t));
+    pb.add_packed_uint32(ttm::Feature::packed_uint32_tags, begin(tags_),
+                         end(tags_));
+  }
+
+  // keys are copied into the arena (metadata of features is short lived)
+  uint32_t get_or_create_index(arena_index_map& map,
+                               std::string_view const key) {
+    if (auto const it = map.find(key); it != end(map)) {
+      return static_cast<uint32_t>(it->second);
+    }
+    auto const idx = map.size();
+    map.emplace(arena_.copy(key), idx);
+    return static_cast<uint32_t>(idx);
   }
 
   void aggregate_geometry() {
@@ -114,8 +192,8 @@ struct layer_builder {
       //   aggregate_polygon_features(std::move(polygon_buffer_),
       //                                              spec_.tile_.z_)) {
 
-      for (auto& f : polygon_buffer_) {
-        f.geometry_ = clip(f.geometry_, spec_.draw_bounds_);
+      for (auto& [f, contained] : polygon_buffer_) {
+        clip_to_draw_bounds(f.geometry_, contained);
         f.geometry_ = shift(f.geometry_, spec_.tile_.z_);
 
         if (f.layer_ != kLayerCoastlineIdx && ctx_.tb_drop_subpixel_polygons_ &&
@@ -130,7 +208,8 @@ struct layer_builder {
     if (ctx_.tb_aggregate_lines_ && !line_buffer_.empty()) {
       for (auto& f :
            aggregate_line_features(std::move(line_buffer_), spec_.tile_.z_)) {
-        f.geometry_ = clip(f.geometry_, spec_.draw_bounds_);
+        // merged lines stay within the union of the bboxes of their parts
+        clip_to_draw_bounds(f.geometry_, lines_contained_);
         f.geometry_ = shift(f.geometry_, spec_.tile_.z_);
         write_feature(f);
       }
@@ -138,15 +217,16 @@ struct layer_builder {
   }
 
   std::string finish() {
-    std::vector<std::string const*> keys(meta_key_cache_.size());
+    std::vector<std::string_view const*> keys(meta_key_cache_.size());
     for (auto const& pair : meta_key_cache_) {
       keys[pair.second] = &pair.first;
     }
     for (auto const& key : keys) {
-      pb_.add_string(ttm::Layer::repeated_string_keys, *key);
+      pb_.add_string(ttm::Layer::repeated_string_keys, key->data(),
+                     key->size());
     }
 
-    std::vector<std::string const*> values(meta_value_cache_.size());
+    std::vector<std::string_view const*> values(meta_value_cache_.size());
     for (auto const& pair : meta_value_cache_) {
       values[pair.second] = &pair.first;
     }
@@ -193,20 +273,27 @@ struct layer_builder {
   }
 
   render_ctx const& ctx_;
+  arena& arena_;
   std::string layer_name_;
   tile_spec const& spec_;
 
   bool has_geometry_;
 
-  std::vector<feature> line_buffer_, polygon_buffer_;
+  std::vector<feature> line_buffer_;
+  bool lines_contained_{true};  // all of line_buffer_
+  std::vector<std::pair<feature, bool /* contained */>> polygon_buffer_;
 
   std::string buf_;
   pbf_builder<ttm::Layer> pb_;
 
-  std::map<std::string, size_t> meta_key_cache_;
-  std::map<std::string, size_t> meta_value_cache_;
+  std::string feature_buf_;
+  std::vector<uint32_t> commands_;  // transcode_geometry scratch
+  arena_vector<uint32_t> tags_;
 
-  std::unordered_set<uint64_t> node_ids_, line_ids_, poly_ids_;
+  arena_index_map meta_key_cache_;
+  arena_index_map meta_value_cache_;
+
+  arena_id_set node_ids_, line_ids_, poly_ids_;
 
   size_t features_added_{0};
   size_t features_written_{0};
@@ -215,13 +302,34 @@ struct layer_builder {
 struct tile_builder::impl {
   impl(render_ctx const& ctx, geo::tile const& tile) : ctx_{ctx}, spec_{tile} {}
 
-  void add_feature(feature f) {
+  void add_feature(feature f, bool const contained) {
     utl::verify(f.layer_ < ctx_.layer_names_.size(), "invalid layer in db");
-    auto& builder = utl::get_or_create(builders_, f.layer_, [&] {
+    get_builder(f.layer_).add_feature(std::move(f), contained);
+  }
+
+  layer_builder& get_builder(size_t const layer) {
+    return *utl::get_or_create(builders_, layer, [&] {
       return std::make_unique<layer_builder>(
-          ctx_, ctx_.layer_names_.at(f.layer_), spec_);
+          ctx_, arena_, ctx_.layer_names_.at(layer), spec_);
     });
-    builder->add_feature(std::move(f));
+  }
+
+  bool is_contained(fixed_box const& bbox) const {
+    return tiles::is_contained(bbox, spec_.draw_bounds_);
+  }
+
+  bool can_transcode(fixed_box const& bbox,
+                     tags::fixed_geometry_type const type) const {
+    return (type == tags::fixed_geometry_type::POINT ||
+            (type == tags::fixed_geometry_type::POLYLINE &&
+             !ctx_.tb_aggregate_lines_)) &&
+           is_contained(bbox);
+  }
+
+  void add_feature(feature const& f, std::string_view const geometry,
+                   std::vector<std::string_view> const& simplify_masks) {
+    utl::verify(f.layer_ < ctx_.layer_names_.size(), "invalid layer in db");
+    get_builder(f.layer_).add_feature(f, geometry, simplify_masks);
   }
 
   std::string finish() {
@@ -237,7 +345,7 @@ struct tile_builder::impl {
     }
 
     if (ctx_.tb_render_debug_info_) {
-      layer_builder lb{ctx_, "tiles_debug_info", spec_};
+      layer_builder lb{ctx_, arena_, "tiles_debug_info", spec_};
       auto const& min = spec_.px_bounds_.min_corner();
       auto const& max = spec_.px_bounds_.max_corner();
 
@@ -250,10 +358,9 @@ struct tile_builder::impl {
         buf.append(fmt::format("[x={}, y={}, z={}]", spec_.tile_.x_,
                                spec_.tile_.y_, spec_.tile_.z_));
 
-        std::vector<uint32_t> t{static_cast<uint32_t>(utl::get_or_create_index(
-                                    lb.meta_key_cache_, "tile_id")),
-                                static_cast<uint32_t>(utl::get_or_create_index(
-                                    lb.meta_value_cache_, buf))};
+        std::vector<uint32_t> t{
+            lb.get_or_create_index(lb.meta_key_cache_, "tile_id"),
+            lb.get_or_create_index(lb.meta_value_cache_, buf)};
         feature_pb.add_packed_uint32(ttm::Feature::packed_uint32_tags, begin(t),
                                      end(t));
 
@@ -283,6 +390,7 @@ struct tile_builder::impl {
 
   render_ctx const& ctx_;
   tile_spec spec_;
+  arena arena_;  // before the builders: outlives them
   std::map<size_t, std::unique_ptr<layer_builder>> builders_;
 };
 
@@ -291,8 +399,26 @@ tile_builder::tile_builder(render_ctx const& ctx, geo::tile const& tile)
 
 tile_builder::~tile_builder() = default;
 
+tile_builder::tile_builder(tile_builder&&) noexcept = default;
+tile_builder& tile_builder::operator=(tile_builder&&) noexcept = default;
+
 void tile_builder::add_feature(feature f) const {
-  impl_->add_feature(std::move(f));
+  impl_->add_feature(std::move(f), false);
+}
+
+void tile_builder::add_feature(feature f, fixed_box const& bbox) const {
+  impl_->add_feature(std::move(f), impl_->is_contained(bbox));
+}
+
+bool tile_builder::can_transcode(fixed_box const& bbox,
+                                 tags::fixed_geometry_type const type) const {
+  return impl_->can_transcode(bbox, type);
+}
+
+void tile_builder::add_feature(
+    feature f, std::string_view const geometry,
+    std::vector<std::string_view> const& simplify_masks) const {
+  impl_->add_feature(f, geometry, simplify_masks);
 }
 
 std::string tile_builder::finish() const { return impl_->finish(); }
@@ -36,6 +36,8 @@ void perf_report_get_tile(perf_counter& pc) {
   print<printable_ns>(" GET: RENDER", pc.finished_[perf_task::GET_TILE_RENDER]);
   print<printable_ns>(" GET: COMPRESS",
                       pc.finished_[perf_task::GET_TILE_COMPRESS]);
+  print<printable_ns>(" GET: OVERZOOM",
+                      pc.finished_[perf_task::GET_TILE_OVERZOOM]);
 
   print<printable_ns>("RNDR: FIND SEASIDE",
                       pc.finished_[perf_task::RENDER_TILE_FIND_SEASIDE]);
@@ -0,0 +1,182 @@
+#include "tiles/perf_metrics.h"
+
+#include <utility>
+
+#include "fmt/core.h"
+
+#include "utl/verify.h"
+
+namespace tiles {
+
+namespace {
+
+std::atomic_uint64_t next_metrics_id{0};
+
+// (perf_metrics::id_, slot): ids are never reused, a new perf_metrics at the
+// address of a destroyed one does not see stale slots
+thread_local std::vector<std::pair<uint64_t, thread_metrics*>> local_slots;
+
+struct histogram_snapshot {
+  void add(histogram const& h) {
+    for (auto i = 0U; i < histogram::kBucketCount; ++i) {
+      buckets_[i] += h.buckets_[i].load(std::memory_order_relaxed);
+    }
+    count_ += h.count_.load(std::memory_order_relaxed);
+    sum_ += h.sum_.load(std::memory_order_relaxed);
+  }
+
+  std::array<uint64_t, histogram::kBucketCount> buckets_{};
+  uint64_t count_{0}, sum_{0};
+};
+
+// name: without unit suffix, labels: e.g. task="foo"
+void write_histogram(std::string& out, char const* name, char const* labels,
+                     histogram_snapshot const& h, double const scale) {
+  auto const sep = labels[0] == '\0' ? "" : ",";
+
+  auto cumulative = 0ULL;
+  for (auto i = 0U; i < histogram::kBucketCount; ++i) {
+    cumulative += h.buckets_[i];
+    if (i + 1 == histogram::kBucketCount) {
+      out += fmt::format("{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels,
+                         sep, cumulative);
+    } else {
+      auto const le =
+          static_cast<double>(1ULL << (histogram::kFirstBucketLog2 + i)) *
+          scale;
+      out += fmt::format("{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, sep,
+                         le, cumulative);
+    }
+  }
+  out += fmt::format("{}_sum{{{}}} {}\n", name, labels,
+                     static_cast<double>(h.sum_) * scale);
+  out += fmt::format("{}_count{{{}}} {}\n", name, labels, h.count_);
+}
+
+constexpr std::array<char const*, perf_task::SIZE> kTaskNames{
+    "result_size",
+    "get_tile_total",
+    "get_tile_fetch",
+    "get_tile_render",
+    "get_tile_compress",
+    "get_tile_overzoom",
+    "render_tile_find_seaside",
+    "render_tile_add_seaside",
+    "render_tile_query_feature",
+    "render_tile_iter_feature",
+    "render_tile_deser_feature_okay",
+    "render_tile_deser_feature_skip",
+    "render_tile_add_feature",
+    "render_tile_finish"};
+
+}  // namespace
+
+perf_metrics::perf_metrics() : id_{next_metrics_id++} {}
+
+perf_metrics::~perf_metrics() = default;
+
+thread_metrics& perf_metrics::local() {
+  for (auto const& [id, slot] : local_slots) {
+    if (id == id_) {
+      return *slot;
+    }
+  }
+
+  auto* slot = [&] {
+    std::lock_guard<std::mutex> l{mutex_};
+    return threads_.emplace_back(std::make_unique<thread_metrics>()).get();
+  }();
+  local_slots.emplace_back(id_, slot);
+  return *slot;
+}
+
+void perf_metrics::record(perf_counter const& pc) {
+  auto& m = local();
+  for (auto i = 0U; i < perf_task::SIZE; ++i) {
+    for (auto const v : pc.finished_[i]) {
+      m.tasks_[i].record(v);
+    }
+  }
+}
+
+void perf_metrics::record_request(uint32_t const z, uint64_t const duration_ns,
+                                  uint64_t const bytes) {
+  utl::verify(z <= kMaxZoomLevel, "record_request: invalid zoom level");
+  auto& zm = local().zoom_[z];
+  histogram::increment(zm.requests_, 1);
+  histogram::increment(zm.bytes_, bytes);
+  zm.latency_.record(duration_ns);
+}
+
+std::string perf_metrics::to_prometheus() const {
+  std::array<histogram_snapshot, perf_task::SIZE> tasks;
+  std::array<histogram_snapshot, kMaxZoomLevel + 1> latency;
+  std::array<uint64_t, kMaxZoomLevel + 1> requests{}, bytes{};
+  {
+    std::lock_guard<std::mutex> l{mutex_};
+    for (auto const& t : threads_) {
+      for (auto i = 0U; i < perf_task::SIZE; ++i) {
+        tasks[i].add(t->tasks_[i]);
+      }
+      for (auto z = 0U; z <= kMaxZoomLevel; ++z) {
+        requests[z] += t->zoom_[z].requests_.load(std::memory_order_relaxed);
+        bytes[z] += t->zoom_[z].bytes_.load(std::memory_order_relaxed);
+        latency[z].add(t->zoom_[z].latency_);
+      }
+    }
+  }
+
+  std::string out;
+  out +=
+      "# HELP tiles_tile_size_bytes Size of rendered tiles.\n"
+      "# TYPE tiles_tile_size_bytes histogram\n";
+  write_histogram(out, "tiles_tile_size_bytes", "",
+                  tasks[perf_task::RESULT_SIZE], 1.);
+
+  out +=
+      "# HELP tiles_perf_task_seconds Duration of tile processing steps.\n"
+      "# TYPE tiles_perf_task_seconds histogram\n";
+  for (auto i = 0U; i < perf_task::SIZE; ++i) {
+    if (i != perf_task::RESULT_SIZE) {
+      write_histogram(out, "tiles_perf_task_seconds",
+                      fmt::format("task=\"{}\"", kTaskNames[i]).c_str(),
+                      tasks[i], 1e-9);
+    }
+  }
+
+  // only zoom levels which have been requested at all
+  out +=
+      "# HELP tiles_requests_total Tile requests per zoom level.\n"
+      "# TYPE tiles_requests_total counter\n";
+  for (auto z = 0U; z <= kMaxZoomLevel; ++z) {
+    if (requests[z] != 0) {
+      out += fmt::format("tiles_requests_total{{z=\"{}\"}} {}\n", z,
+                         requests[z]);
+    }
+  }
+
+  out +=
+      "# HELP tiles_response_bytes_total Tile bytes sent per zoom level.\n"
+      "# TYPE tiles_response_bytes_total counter\n";
+  for (auto z = 0U; z <= kMaxZoomLevel; ++z) {
+    if (requests[z] != 0) {
+      out += fmt::format("tiles_response_bytes_total{{z=\"{}\"}} {}\n", z,
+                         bytes[z]);
+    }
+  }
+
+  out +=
+      "# HELP tiles_request_duration_seconds Tile request latency per zoom "
+      "level.\n"
+      "# TYPE tiles_request_duration_seconds histogram\n";
+  for (auto z = 0U; z <= kMaxZoomLevel; ++z) {
+    if (requests[z] != 0) {
+      write_histogram(out, "tiles_request_duration_seconds",
+                      fmt::format("z=\"{}\"", z).c_str(), latency[z], 1e-9);
+    }
+  }
+
+  return out;
+}
+
+}  // namespace tiles
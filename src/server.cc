@@ -1,9 +1,18 @@
+#include <algorithm>
+#include <condition_variable>
 #include <cstdlib>
 #include <exception>
-#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 #include "boost/algorithm/string/predicate.hpp"
 #include "boost/asio.hpp"
@@ -15,13 +24,25 @@
 #include "conf/configuration.h"
 #include "conf/options_parser.h"
 
+#include "utl/erase_if.h"
 #include "utl/parser/mmap_reader.h"
+#include "utl/raii.h"
 
+#include "tiles/access_log.h"
+#include "tiles/cancel_token.h"
 #include "tiles/db/tile_database.h"
+#include "tiles/db/tile_etag.h"
+#include "tiles/db/warm_up.h"
 #include "tiles/get_tile.h"
+#include "tiles/mvt/overzoom.h"
 #include "tiles/parse_tile_url.h"
 #include "tiles/perf_counter.h"
+#include "tiles/perf_metrics.h"
+#include "tiles/single_flight.h"
+#include "tiles/tile_batch.h"
+#include "tiles/tile_cache.h"
 #include "tiles/util.h"
+#include "tiles/util_parallel.h"
 
 #include "pbf_sdf_fonts_res.h"
 #include "tiles_server_res.h"
@@ -36,129 +57,644 @@ using tcp = boost::asio::ip::tcp;  // from "boost/asio/ip/tcp.hpp"
 
 namespace tiles {
 
+// Response body referencing memory owned by someone else (LMDB map, cached
+// tile, embedded resource): pin_ keeps it valid until the response is sent.
+struct pinned_body {
+  struct value_type {
+    value_type() = default;
+    value_type(std::string_view data, std::shared_ptr<void const> pin)
+        : data_{data}, pin_{std::move(pin)} {}
+
+    explicit value_type(std::shared_ptr<std::string const> str)
+        : data_{*str}, pin_{std::move(str)} {}
+
+    size_t size() const { return data_.size(); }
+
+    std::string_view data_;
+    std::shared_ptr<void const> pin_;
+  };
+
+  static std::uint64_t size(value_type const& body) { return body.size(); }
+
+  struct writer {
+    using const_buffers_type = net::const_buffer;
+
+    template <bool IsRequest, class Fields>
+    writer(http::header<IsRequest, Fields> const&, value_type const& body)
+        : body_{body} {}
+
+    void init(beast::error_code& ec) { ec = {}; }
+
+    boost::optional<std::pair<const_buffers_type, bool>> get(
+        beast::error_code& ec) {
+      ec = {};
+      return {{net::const_buffer{body_.data_.data(), body_.data_.size()},
+               false}};
+    }
+
+    value_type const& body_;
+  };
+};
+
 using request_t = http::request<http::dynamic_body>;
-using response_t = http::response<http::string_body>;
-using callback_t = std::function<void(request_t const&, response_t&)>;
-
-std::string url_decode(request_t const& req) {
-  auto const& in = req.target();
-  std::string out;
-  out.reserve(in.size());
-  for (std::size_t i = 0; i < in.size(); ++i) {
-    if (in[i] == '%') {
-      utl::verify(i + 3 <= in.size(), "invalid url");
-      int value = 0;
-      std::istringstream is{std::string{in.substr(i + 1, 2)}};
-      utl::verify(static_cast<bool>(is >> std::hex >> value), "invalid url");
-      out += static_cast<char>(value);
-      i += 2;
-    } else if (in[i] == '+') {
-      out += ' ';
-    } else {
-      out += in[i];
+using response_t = http::response<pinned_body>;
+// the callback has to call done exactly once, when response_t is ready
+// the cancel token is cancelled when the client is gone before that
+using done_fn_t = std::function<void()>;
+using callback_t = std::function<void(request_t const&, response_t&,
+                                      cancel_token_ptr const&, done_fn_t)>;
+
+// outcome of a (possibly shared) tile render
+struct render_result {
+  tile_cache::value_t tile_;  // nullptr: failed with status_
+  http::status status_{http::status::ok};
+  uint64_t render_ns_{0};
+};
+
+// outcome of a (possibly shared) metatile render
+struct metatile_result {
+  render_result get(geo::tile const& tile) const {
+    for (auto const& [t, value] : tiles_) {
+      if (t == tile) {
+        return {value, status_, render_ns_};
+      }
     }
+    return {nullptr,
+            status_ == http::status::ok ? http::status::internal_server_error
+                                        : status_,
+            render_ns_};
   }
-  return out;
+
+  std::vector<std::pair<geo::tile, tile_cache::value_t>> tiles_;
+  http::status status_{http::status::ok};  // of all tiles if tiles_ empty
+  uint64_t render_ns_{0};
+};
+
+// state of a batch request shared by the render workers
+struct tile_batch_job {
+  std::vector<geo::tile> tiles_;
+  std::vector<pinned_body::value_type> results_;  // per tile
+  std::vector<std::vector<std::pair<geo::tile, pack_record>>> packs_;
+  std::vector<size_t> to_render_;  // indices into tiles_
+  cancel_token_ptr cancel_;
+
+  std::atomic_size_t next_{0};  // into to_render_
+  std::atomic_size_t workers_{0};  // running, the last one responds
+  std::atomic_bool failed_{false};
+};
+
+uint64_t ns_since(std::chrono::steady_clock::time_point const start) {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now() - start).count();
 }
 
-struct http_connection : public std::enable_shared_from_this<http_connection> {
-  http_connection(tcp::socket socket, callback_t const& callback)
-      : socket_{std::move(socket)}, callback_{callback} {}
+struct server_settings : public conf::configuration {
+  server_settings() : configuration("tiles-server options", "") {
+    param(db_fname_, "db_fname", "/path/to/tiles.mdb");
+    param(res_dname_, "res_dname", "/path/to/res");
+    param(address_, "address", "the address the http port is bound to");
+    param(port_, "port", "the http port of the server (0 = no tcp)");
+    param(unix_socket_, "unix_socket",
+          "path of a unix domain socket to listen on as well (e.g. for a "
+          "reverse proxy on the same host)");
+    param(idle_timeout_, "idle_timeout",
+          "seconds an idle keep-alive connection is kept open");
+    param(tile_cache_size_, "tile_cache_size",
+          "MB of memory for rendered tiles (0 = no cache)");
+    param(tile_cache_shards_, "tile_cache_shards",
+          "independently locked partitions of the tile cache");
+    param(feature_cache_size_, "feature_cache_size",
+          "MB of memory for decoded features shared by renders (0 = no "
+          "cache)");
+    param(io_threads_, "io_threads",
+          "threads for network i/o, static files and prepared tiles");
+    param(reuse_port_, "reuse_port",
+          "one io_context and listening socket (SO_REUSEPORT) per i/o "
+          "thread: connections stay on the thread which accepted them");
+    param(pin_io_threads_, "pin_io_threads",
+          "pin i/o thread i to cpu i (linux)");
+    param(render_threads_, "render_threads",
+          "threads rendering tiles (0 = hardware concurrency)");
+    param(render_queue_size_, "render_queue_size",
+          "max queued or running renders before answering 503");
+    param(prepared_max_age_, "prepared_max_age",
+          "Cache-Control max-age (seconds) for prepared tiles");
+    param(rendered_max_age_, "rendered_max_age",
+          "Cache-Control max-age (seconds) for rendered tiles");
+    param(access_log_, "access_log",
+          "tile access log file (- = stderr, empty = disabled)");
+    param(access_log_sample_, "access_log_sample",
+          "log every n-th successful tile request (errors: all)");
+    param(access_log_capacity_, "access_log_capacity",
+          "max buffered access log entries (more are dropped)");
+    param(perf_report_, "perf_report",
+          "print a performance report for every rendered tile");
+    param(batch_max_tiles_, "batch_max_tiles",
+          "max tiles of a single POST /batch request");
+    param(max_data_zoom_, "max_data_zoom",
+          "tiles above are sliced from their ancestor on this zoom level "
+          "instead of being rendered (e.g. 16: no more detail in the data)");
+    param(render_budget_, "render_budget",
+          "ms a render may take before the tile is derived from an ancestor "
+          "(0 = unlimited)");
+    param(overzoom_fallback_, "overzoom_fallback",
+          "derive tiles from a prepared or cached ancestor when over budget "
+          "or when the render queue is full");
+    param(fallback_render_, "fallback_render",
+          "render tiles derived from an ancestor in the background (cache)");
+    param(metatile_levels_, "metatile_levels",
+          "render 2^n x 2^n neighbours on a cache miss (0 = single tiles)");
+    param(db_watch_interval_, "db_watch_interval",
+          "seconds between checks for a new database (0 = only on SIGHUP)");
+    param(warm_up_, "warm_up",
+          "pre-fault prepared tiles and hot feature packs in the background "
+          "on startup, /health answers 503 until done");
+    param(warm_up_max_zoom_, "warm_up_max_zoom",
+          "prepared tiles up to this zoom level are pre-faulted");
+    param(warm_up_tiles_, "warm_up_tiles",
+          "file with hot tiles (syntax of POST /batch: z/x/y or bbox lines) "
+          "whose feature packs are pre-faulted");
+    param(db_max_readers_, "db_max_readers",
+          "max concurrent database readers (incl. responses being sent)");
+  }
+
+  std::string db_fname_{"tiles.mdb"};
+  std::string res_dname_;
+  std::string address_{"0.0.0.0"};
+  uint16_t port_{8888};
+  std::string unix_socket_;
+  uint32_t idle_timeout_{60};
+  size_t tile_cache_size_{256};
+  size_t tile_cache_shards_{16};
+  size_t feature_cache_size_{128};
+  uint32_t io_threads_{2};
+  bool reuse_port_{false};
+  bool pin_io_threads_{false};
+  uint32_t render_threads_{0};
+  size_t render_queue_size_{256};
+  uint32_t prepared_max_age_{86400};
+  uint32_t rendered_max_age_{3600};
+  size_t batch_max_tiles_{1024};
+  uint32_t max_data_zoom_{kMaxZoomLevel};
+  uint32_t render_budget_{0};
+  bool overzoom_fallback_{true};
+  bool fallback_render_{true};
+  uint32_t metatile_levels_{1};
+  uint32_t db_max_readers_{1024};
+  uint32_t db_watch_interval_{0};
+  bool warm_up_{false};
+  uint32_t warm_up_max_zoom_{10};
+  std::string warm_up_tiles_;
+  std::string access_log_;
+  uint32_t access_log_sample_{1};
+  size_t access_log_capacity_{64 * 1024};
+  bool perf_report_{false};
+};
+
+// One connection serves any number of requests: responses are written in
+// request order, pipelined requests simply wait in buffer_ until the previous
+// response is out. deadline_ only runs while waiting for a request.
+//
+// Socket: tcp::socket or local_stream::socket (unix domain socket).
+template <typename Socket>
+struct http_connection
+    : public std::enable_shared_from_this<http_connection<Socket>> {
+  http_connection(Socket socket, callback_t const& callback,
+                  std::chrono::seconds idle_timeout)
+      : socket_{std::move(socket)},
+        callback_{callback},
+        idle_timeout_{idle_timeout} {}
 
   void start() {
-    auto self = shared_from_this();
-    http::async_read(
-        socket_, buffer_, request_, [self](beast::error_code ec, std::size_t) {
-          if (!ec) {
-            self->response_.version(self->request_.version());
-            self->response_.keep_alive(false);
+    check_deadline();
+    read_request();
+  }
 
-            try {
-              self->callback_(self->request_, self->response_);
-            } catch (std::exception const& e) {
-              tiles::t_log("unhandled error: {}", e.what());
-              self->response_.result(http::status::internal_server_error);
-            } catch (...) {
-              tiles::t_log("unhandled unknown error");
-              self->response_.result(http::status::internal_server_error);
+  void read_request() {
+    request_ = {};
+    deadline_.expires_after(idle_timeout_);
+
+    auto self = this->shared_from_this();
+    http::async_read(socket_, buffer_, request_,
+                     [self](beast::error_code ec, std::size_t) {
+                       if (ec) {
+                         self->close();  // incl. end_of_stream and timeout
+                         return;
+                       }
+                       self->handle_request();
+                     });
+  }
+
+  void handle_request() {
+    deadline_.expires_at(net::steady_timer::time_point::max());
+
+    response_ = {};
+    response_.version(request_.version());
+    response_.keep_alive(request_.keep_alive());
+    responded_ = false;
+    cancel_ = std::make_shared<cancel_token>();
+
+    // done may be called from any thread (e.g. a render worker)
+    auto self = this->shared_from_this();
+    auto done = [self] {
+      if (!self->responded_.exchange(true)) {
+        net::post(self->socket_.get_executor(),
+                  [self] { self->write_response(); });
+      }
+    };
+
+    try {
+      callback_(request_, response_, cancel_, done);
+    } catch (std::exception const& e) {
+      tiles::t_log("unhandled error: {}", e.what());
+      response_.result(http::status::internal_server_error);
+      done();
+    } catch (...) {
+      tiles::t_log("unhandled unknown error");
+      response_.result(http::status::internal_server_error);
+      done();
+    }
+
+    if (!responded_) {
+      watch_disconnect();
+    }
+  }
+
+  // Nobody reads while the response is prepared: the request is cancelled
+  // if the connection fails (error, reset). A clean end of stream may be a
+  // half-close (the response is still wanted), data is a pipelined request.
+  // Both stay readable: afterwards, only errors are watched.
+  void watch_disconnect(
+      typename Socket::wait_type const wait = Socket::wait_read) {
+    watching_ = true;
+    auto self = this->shared_from_this();
+    socket_.async_wait(
+        wait, [self, wait, id = ++watch_id_](beast::error_code ec) {
+          if (!self->watching_ || id != self->watch_id_) {
+            return;  // response written in the meantime
+          }
+          self->watching_ = false;
+          if (!ec && wait == Socket::wait_read) {
+            char c = 0;
+            self->socket_.non_blocking(true, ec);  // async ops: unaffected
+            if (!ec) {
+              self->socket_.receive(net::buffer(&c, 1), Socket::message_peek,
+                                    ec);
+            }
+            if (!ec || ec == net::error::eof) {
+              self->watch_disconnect(Socket::wait_error);
+              return;
+            }
+            if (ec == net::error::would_block) {
+              self->watch_disconnect(Socket::wait_read);  // spurious
+              return;
             }
-            self->response_.set(http::field::content_length,
-                                std::to_string(self->response_.body().size()));
-            http::async_write(self->socket_, self->response_,
-                              [self](beast::error_code ec, std::size_t) {
-                                self->socket_.shutdown(
-                                    tcp::socket::shutdown_send, ec);
-                                self->deadline_.cancel();
-                              });
           }
+          self->cancel_->cancel();
         });
-    check_deadline();
+  }
+
+  void write_response() {
+    if (watching_) {
+      watching_ = false;
+      beast::error_code ec;
+      socket_.cancel(ec);  // the watch, no other operation is pending
+    }
+
+    if (response_.result() == http::status::not_modified ||
+        response_.result() == http::status::no_content) {
+      response_.body() = {};  // no content, no length
+    } else {
+      response_.set(http::field::content_length,
+                    std::to_string(response_.body().size()));
+    }
+    if (request_.method() == http::verb::head) {
+      response_.body() = {};  // must not leak into the next response
+    }
+
+    auto self = this->shared_from_this();
+    http::async_write(socket_, response_,
+                      [self](beast::error_code ec, std::size_t) {
+                        if (ec || self->response_.need_eof()) {
+                          self->close();
+                          return;
+                        }
+                        self->read_request();
+                      });
   }
 
   void check_deadline() {
-    auto self = shared_from_this();
-    deadline_.async_wait([self](beast::error_code ec) {
-      if (!ec) {
-        self->socket_.close(ec);
+    auto self = this->shared_from_this();
+    deadline_.async_wait([self](beast::error_code) {
+      if (self->closed_) {
+        return;
+      }
+      if (self->deadline_.expiry() <= net::steady_timer::clock_type::now()) {
+        self->close();
+        return;
       }
+      self->check_deadline();  // deadline was moved
     });
   }
 
-  tcp::socket socket_;
+  void close() {
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    if (cancel_ != nullptr) {
+      cancel_->cancel();
+    }
+
+    beast::error_code ec;
+    socket_.shutdown(Socket::shutdown_both, ec);
+    socket_.close(ec);
+    deadline_.cancel();
+  }
+
+  Socket socket_;
   beast::flat_buffer buffer_{8192};
   request_t request_;
   response_t response_;
   callback_t const& callback_;
-  net::steady_timer deadline_{socket_.get_executor(), std::chrono::seconds(60)};
+  std::chrono::seconds idle_timeout_;
+  net::steady_timer deadline_{socket_.get_executor()};
+  std::atomic_bool responded_{false};
+  cancel_token_ptr cancel_;
+  bool watching_{false};
+  uint64_t watch_id_{0};
+  bool closed_{false};
 };
 
-void http_server(tcp::acceptor& acceptor, tcp::socket& socket,
-                 callback_t const& cb) {
-  acceptor.async_accept(socket, [&](beast::error_code ec) {
-    if (!ec) {
-      std::make_shared<http_connection>(std::move(socket), cb)->start();
+// executor for the next accepted connection: each connection needs its own
+// strand (deadline and i/o handlers must not run concurrently) unless only one
+// thread runs the io_context
+using executor_fn_t = std::function<net::any_io_executor()>;
+
+template <typename Acceptor>
+void http_server(Acceptor& acceptor, callback_t const& cb,
+                 std::chrono::seconds const idle_timeout,
+                 executor_fn_t const& next_executor) {
+  using socket_t = typename Acceptor::protocol_type::socket;
+  acceptor.async_accept(
+      next_executor(),
+      [&, idle_timeout](beast::error_code ec, socket_t socket) {
+        if (!ec) {
+          std::make_shared<http_connection<socket_t>>(std::move(socket), cb,
+                                                      idle_timeout)
+              ->start();
+        }
+        http_server(acceptor, cb, idle_timeout, next_executor);
+      });
+}
+
+std::unique_ptr<tcp::acceptor> make_acceptor(net::io_context& ioc,
+                                             tcp::endpoint const& endpoint,
+                                             bool const reuse_port) {
+  auto acceptor = std::make_unique<tcp::acceptor>(ioc);
+  acceptor->open(endpoint.protocol());
+  acceptor->set_option(net::socket_base::reuse_address{true});
+  if (reuse_port) {
+#ifdef SO_REUSEPORT
+    acceptor->set_option(
+        net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>{true});
+#else
+    throw utl::fail("reuse_port: SO_REUSEPORT not supported");
+#endif
+  }
+  acceptor->bind(endpoint);
+  acceptor->listen(net::socket_base::max_listen_connections);
+  return acceptor;
+}
+
+// pins the calling thread
+void pin_io_thread(unsigned const i) {
+#ifdef __linux__
+  auto const cpus = std::max(std::thread::hardware_concurrency(), 1U);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(i % cpus, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    t_log("could not pin i/o thread {} to cpu {}", i, i % cpus);
+  }
+#else
+  t_log("pin_io_threads: not supported, i/o thread {} not pinned", i);
+#endif
+}
+
+// One io_context for all i/o threads or one per thread (reuse_port: the
+// kernel distributes connections over the listening sockets, no handler ever
+// leaves the thread which accepted the connection).
+std::vector<std::unique_ptr<net::io_context>> make_io_contexts(
+    server_settings const& opt) {
+  auto const threads = std::max(opt.io_threads_, 1U);
+  std::vector<std::unique_ptr<net::io_context>> iocs;
+  if (opt.reuse_port_) {
+    for (auto i = 0U; i < threads; ++i) {
+      iocs.emplace_back(std::make_unique<net::io_context>(1));
     }
-    http_server(acceptor, socket, cb);
-  });
+  } else {
+    iocs.emplace_back(
+        std::make_unique<net::io_context>(static_cast<int>(threads)));
+  }
+  return iocs;
 }
 
-void serve_forever(std::string const& address, uint16_t port, callback_t&& cb) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+using local_stream = net::local::stream_protocol;
+
+std::unique_ptr<local_stream::acceptor> make_unix_acceptor(
+    net::io_context& ioc, std::string const& path) {
+  namespace fs = boost::filesystem;
+  auto const type = fs::symlink_status(path).type();
+  if (type == fs::socket_file) {
+    fs::remove(path);  // stale socket of a previous run
+  } else {
+    utl::verify(type == fs::file_not_found,
+                "unix_socket: {} exists and is not a socket", path);
+  }
+  return std::make_unique<local_stream::acceptor>(
+      ioc, local_stream::endpoint{path});
+}
+#endif
+
+void serve_forever(std::vector<std::unique_ptr<net::io_context>>& iocs,
+                   server_settings const& opt, callback_t&& cb) {
   try {
-    net::io_context ioc{static_cast<int>(std::thread::hardware_concurrency())};
-    tcp::acceptor acceptor{ioc, {net::ip::make_address(address), port}};
-    tcp::socket socket{ioc};
-    http_server(acceptor, socket, cb);
+    utl::verify(opt.port_ != 0 || !opt.unix_socket_.empty(),
+                "neither tcp port nor unix socket given");
+
+    auto const sharded = iocs.size() > 1;
+    auto const idle_timeout = std::chrono::seconds{opt.idle_timeout_};
+
+    executor_fn_t const shared_executor = [&] {
+      return net::any_io_executor{
+          net::make_strand(iocs.front()->get_executor())};
+    };
+    std::vector<executor_fn_t> shard_executors;
+    for (auto& ioc : iocs) {
+      shard_executors.emplace_back(
+          [&ioc] { return net::any_io_executor{ioc->get_executor()}; });
+    }
 
-    boost::asio::signal_set signals(ioc, SIGINT, SIGTERM);
-    signals.async_wait(
-        [&](boost::system::error_code const&, int) { ioc.stop(); });
+    std::vector<std::unique_ptr<tcp::acceptor>> acceptors;
+    if (opt.port_ != 0) {
+      tcp::endpoint const endpoint{net::ip::make_address(opt.address_),
+                                   opt.port_};
+      for (auto i = 0ULL; i < iocs.size(); ++i) {
+        acceptors.emplace_back(
+            make_acceptor(*iocs[i], endpoint, opt.reuse_port_));
+        http_server(*acceptors.back(), cb, idle_timeout,
+                    sharded ? shard_executors[i] : shared_executor);
+      }
+      t_log("tiles-server listening on {}:{} ({} sockets)", opt.address_,
+            opt.port_, acceptors.size());
+    }
 
-    std::vector<std::thread> threads;
-    for (auto i = 1ULL; i < std::thread::hardware_concurrency(); ++i) {
-      threads.emplace_back([&ioc] { ioc.run(); });
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    // one socket: connections are handed to the shards round robin
+    executor_fn_t const round_robin = [&, next = size_t{0}]() mutable {
+      return shard_executors[next++ % shard_executors.size()]();
+    };
+    std::unique_ptr<local_stream::acceptor> unix_acceptor;
+    if (!opt.unix_socket_.empty()) {
+      unix_acceptor = make_unix_acceptor(*iocs.front(), opt.unix_socket_);
+      http_server(*unix_acceptor, cb, idle_timeout,
+                  sharded ? round_robin : shared_executor);
+      t_log("tiles-server listening on unix:{}", opt.unix_socket_);
+    }
+#else
+    utl::verify(opt.unix_socket_.empty(), "unix sockets not supported");
+#endif
+
+    boost::asio::signal_set signals(*iocs.front(), SIGINT, SIGTERM);
+    signals.async_wait([&](boost::system::error_code const&, int) {
+      for (auto& ioc : iocs) {
+        ioc->stop();
+      }
+    });
+
+    auto const threads = std::max(opt.io_threads_, 1U);
+    std::vector<std::thread> workers;
+    for (auto i = 1U; i < threads; ++i) {
+      auto& ioc = *iocs[sharded ? i : 0];
+      workers.emplace_back([&ioc, &opt, i] {
+        if (opt.pin_io_threads_) {
+          pin_io_thread(i);
+        }
+        ioc.run();
+      });
+    }
+    if (opt.pin_io_threads_) {
+      pin_io_thread(0);
     }
 
-    t_log("tiles-server started on {}:{}", address, port);
-    ioc.run();
+    t_log("tiles-server started");
+    iocs.front()->run();
 
-    std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
+    std::for_each(begin(workers), end(workers), [](auto& t) { t.join(); });
+
+    if (!opt.unix_socket_.empty()) {
+      boost::system::error_code ec;
+      boost::filesystem::remove(opt.unix_socket_, ec);
+    }
   } catch (std::exception const& e) {
     std::cerr << "Error: " << e.what() << std::endl;
   }
 }
 
-struct server_settings : public conf::configuration {
-  server_settings() : configuration("tiles-server options", "") {
-    param(db_fname_, "db_fname", "/path/to/tiles.mdb");
-    param(res_dname_, "res_dname", "/path/to/res");
-    param(port_, "port", "the http port of the server");
+// One version of the database (tiles.mdb, tiles.pck) and everything derived
+// from it. Requests hold it (directly or through a transaction lease) until
+// their response is written: a replaced generation is closed once drained.
+//
+// db_fname is resolved first: new versions should be deployed under a new
+// name and activated by switching a symlink (a database replaced in place
+// would share the LMDB lock file with its predecessor: reloads of a path
+// which is still open are refused).
+struct db_generation : public std::enable_shared_from_this<db_generation> {
+  db_generation(server_settings const& opt, uint64_t const id)
+      : id_{id},
+        path_{boost::filesystem::canonical(opt.db_fname_).string()},
+        // NOTLS: pooled read transactions are used by i/o and render threads
+        // and pinned by responses until they are written
+        env_{make_tile_database(
+            path_.c_str(), kDefaultSize,
+            lmdb::env_open_flags::NOSUBDIR | lmdb::env_open_flags::NOTLS,
+            opt.db_max_readers_)},
+        handle_{env_},
+        unbounded_ctx_{make_render_ctx(handle_)},
+        pack_handle_{path_.c_str()},
+        // the others for renders, warm up, etc.
+        txn_pool_{handle_, opt.db_max_readers_ / 2} {
+    unbounded_ctx_.max_data_zoom_level_ = opt.max_data_zoom_;
+    if (opt.feature_cache_size_ != 0) {
+      unbounded_ctx_.feature_cache_ = std::make_shared<feature_cache>(
+          opt.feature_cache_size_ * 1024 * 1024, opt.tile_cache_shards_);
+    }
+    render_ctx_ = unbounded_ctx_;
+    render_ctx_.render_budget_ = std::chrono::milliseconds{opt.render_budget_};
+
+    {
+      auto txn = txn_pool_.acquire();
+      etag_generation_ = get_database_generation(handle_, txn->txn());
+    }
+
+    if (opt.tile_cache_size_ != 0) {
+      cache_ = std::make_unique<tile_cache>(
+          opt.tile_cache_size_ * 1024 * 1024, opt.tile_cache_shards_);
+    }
   }
 
-  std::string db_fname_{"tiles.mdb"};
-  std::string res_dname_;
-  uint16_t port_{8888};
+  ~db_generation() { t_log("database generation {} closed: {}", id_, path_); }
+
+  db_generation(db_generation const&) = delete;
+  db_generation(db_generation&&) = delete;
+  db_generation& operator=(db_generation const&) = delete;
+  db_generation& operator=(db_generation&&) = delete;
+
+  // prepared tiles are a single lookup anyway, cache only rendered ones
+  bool is_rendered(geo::tile const& tile) const {
+    return render_ctx_.ignore_prepared_ ||
+           static_cast<int>(tile.z_) > render_ctx_.max_prepared_zoom_level_;
+  }
+
+  // the lease keeps the generation alive (e.g. pinned by a response)
+  std::shared_ptr<read_txn> acquire_txn() {
+    auto txn = txn_pool_.acquire();
+    auto* ptr = txn.get();
+    // members are destroyed in reverse: the lease is returned first
+    return {std::make_shared<std::pair<std::shared_ptr<db_generation>,
+                                       std::shared_ptr<read_txn>>>(
+                shared_from_this(), std::move(txn)),
+            ptr};
+  }
+
+  uint64_t id_;
+  std::string path_;
+  lmdb::env env_;
+  tile_db_handle handle_;
+  render_ctx unbounded_ctx_, render_ctx_;
+  pack_handle pack_handle_;
+  read_txn_pool txn_pool_;
+  uint64_t etag_generation_{0};
+  std::unique_ptr<tile_cache> cache_;
+
+  // concurrent requests for the same (meta)tile wait for the first render
+  // which is abandoned when all of them are cancelled
+  single_flight<tile_key_t, metatile_result> renders_;
 };
 
+using db_generation_ptr = std::shared_ptr<db_generation>;
+
+// resolved path and modification times: a change means a new generation
+std::string db_version(std::string const& db_fname) {
+  namespace fs = boost::filesystem;
+  auto const path = fs::canonical(db_fname);
+  auto const pck = pack_file_name(path.string().c_str());
+  return fmt::format("{}:{}:{}", path.string(), fs::last_write_time(path),
+                     fs::exists(pck) ? fs::last_write_time(pck) : 0);
+}
+
 int run_tiles_server(int argc, char const** argv) {
   server_settings opt;
 
@@ -182,78 +718,667 @@ int run_tiles_server(int argc, char const** argv) {
   utl::verify(boost::filesystem::is_regular_file(opt.db_fname_.c_str()),
               "tiles database file not found: {}", opt.db_fname_);
 
-  lmdb::env db_env = make_tile_database(opt.db_fname_.c_str(), kDefaultSize);
-  tile_db_handle handle{db_env};
-  auto const render_ctx = make_render_ctx(handle);
-  pack_handle pack_handle{opt.db_fname_.c_str()};
+  // new requests use the current generation (see reload below)
+  auto current = std::make_shared<db_generation>(opt, 0);
+  auto const get_generation = [&] { return std::atomic_load(&current); };
+
+  // destroyed before the database: pending connections may pin transactions
+  auto iocs = make_io_contexts(opt);
+
+  // ready: the load balancer may route traffic (see /health)
+  std::atomic_bool ready{!opt.warm_up_};
+  std::atomic_bool stopping{false};
+
+  auto const warm_up_db = [&](db_generation& gen) {
+    try {
+      auto const start = std::chrono::steady_clock::now();
+      warm_up_stats stats;
+      auto txn = gen.txn_pool_.acquire();
+      warm_up_prepared(txn->txn(), txn->tiles_dbi(), opt.warm_up_max_zoom_,
+                       stats, stopping);
+
+      if (!opt.warm_up_tiles_.empty()) {
+        utl::mmap_reader const mem{opt.warm_up_tiles_.c_str()};
+        auto const tiles = parse_tile_batch({mem.m_.ptr(), mem.m_.size()},
+                                            std::numeric_limits<size_t>::max());
+        utl::verify(tiles.has_value(), "invalid warm_up_tiles file");
 
-  auto const maybe_serve_tile = [&](auto const& req, auto& res) -> bool {
-    static regex_matcher matcher{R"(^\/(\d+)\/(\d+)\/(\d+).mvt$)"};
-    auto const decoded_url = url_decode(req);
-    auto const match = matcher.match(decoded_url);
-    if (!match) {
-      return false;
+        std::vector<geo::tile> rendered;
+        std::copy_if(begin(*tiles), end(*tiles), std::back_inserter(rendered),
+                     [&](auto const& tile) { return gen.is_rendered(tile); });
+        warm_up_packs(
+            [&](geo::tile const& query, auto&& fn) {
+              pack_records_foreach(txn->features_cursor(), query, fn);
+            },
+            gen.pack_handle_, rendered, stats, stopping);
+      }
+
+      t_log("warm-up: {} tiles, {} packs ({}) in {}ms", stats.tiles_,
+            stats.packs_, printable_bytes{stats.bytes_},
+            ns_since(start) / 1'000'000);
+    } catch (std::exception const& e) {
+      t_log("warm-up failed: {}", e.what());
     }
+  };
 
-    if (req[http::field::accept_encoding]  //
-            .find("deflate") == std::string_view::npos) {
-      res.result(http::status::not_implemented);
-      return true;
+  perf_metrics metrics;
+
+  std::unique_ptr<access_log> request_log;
+  if (!opt.access_log_.empty()) {
+    request_log = std::make_unique<access_log>(
+        opt.access_log_, opt.access_log_capacity_, opt.access_log_sample_);
+  }
+
+  auto const with_perf_counter = [&](auto&& fn) {
+    if (opt.perf_report_) {
+      perf_counter pc;
+      auto result = fn(pc);
+      perf_report_get_tile(pc);
+      metrics.record(pc);
+      return result;
     }
+    metrics_perf_counter pc{metrics.local()};
+    return fn(pc);
+  };
 
-    t_log("received a request: {}", req.target());
-    auto const tile = url_match_to_tile(*match);
+  auto const to_value = [](std::optional<std::string>&& opt_tile) {
+    return std::make_shared<std::string const>(
+        opt_tile ? std::move(*opt_tile) : std::string{});
+  };
+
+  // ctx: gen.render_ctx_ or gen.unbounded_ctx_
+  auto const render_tile = [&](db_generation& gen, struct render_ctx const& ctx,
+                               geo::tile const& tile,
+                               cancel_token const& cancel) {
+    auto txn = gen.txn_pool_.acquire();
+    return to_value(with_perf_counter([&](auto& pc) {
+      return get_tile(*txn, gen.pack_handle_, ctx, tile, pc, cancel);
+    }));
+  };
 
-    perf_counter pc;
-    auto rendered_tile = get_tile(handle, pack_handle, render_ctx, tile, pc);
-    perf_report_get_tile(pc);
+  // neighbours only pay off if they can be cached
+  auto const metatile_levels = opt.tile_cache_size_ != 0 ? opt.metatile_levels_
+                                                         : 0U;
+
+  auto const render_metatile = [&](db_generation& gen,
+                                   struct render_ctx const& ctx,
+                                   geo::tile const& root, uint32_t const z,
+                                   cancel_token const& cancel) {
+    auto txn = gen.txn_pool_.acquire();
+    auto metatile = with_perf_counter([&](auto& pc) {
+      return get_metatile(*txn, gen.pack_handle_, ctx, root, z, pc, cancel);
+    });
 
-    if (rendered_tile) {
-      res.body() = std::move(*rendered_tile);
-      res.set(http::field::content_encoding, "deflate");
+    std::vector<std::pair<geo::tile, tile_cache::value_t>> tiles;
+    tiles.reserve(metatile.size());
+    for (auto& [tile, opt_tile] : metatile) {
+      tiles.emplace_back(tile, to_value(std::move(opt_tile)));
+    }
+    return tiles;
+  };
+
+  // above the max data zoom: the data tile is cached, too (zooming clients)
+  auto const render_sliced = [&](db_generation& gen,
+                                 struct render_ctx const& ctx,
+                                 geo::tile const& tile,
+                                 cancel_token const& cancel) {
+    auto const& cache = gen.cache_;
+    auto const ancestor = data_tile(ctx, tile);
+    auto data = cache != nullptr ? cache->get(tile_to_key(ancestor)) : nullptr;
+    if (data == nullptr) {
+      data = render_tile(gen, ctx, ancestor, cancel);
+      if (cache != nullptr) {
+        cache->put(tile_to_key(ancestor), data);
+      }
+    }
+    return to_value(with_perf_counter([&](auto& pc) {
+      return slice_tile(ctx, ancestor, *data, tile, pc);
+    }));
+  };
+
+  // representations differ per encoding: so must strong validators
+  auto const tile_etag = [&](db_generation const& gen, read_txn& txn,
+                             geo::tile const& tile,
+                             content_encoding const encoding) {
+    // prepared levels: never walk the (huge) feature index of the tile
+    auto const hash =
+        gen.is_rendered(tile)
+            ? get_dynamic_etag(txn.features_cursor(), tile,
+                               gen.etag_generation_)
+            : get_prepared_etag(txn.txn(), txn.tiles_dbi(), tile)
+                  .value_or(get_generation_etag(tile, gen.etag_generation_));
+    return fmt::format("\"{:016x}{}\"", hash,
+                       encoding == content_encoding::GZIP       ? "-gz"
+                       : encoding == content_encoding::IDENTITY ? "-id"
+                                                                : "");
+  };
+
+  // stored tiles are zlib streams: "deflate" as-is, gzip/identity transcoded
+  auto const write_tile_data = [](pinned_body::value_type data,
+                                  content_encoding const encoding,
+                                  response_t& res) {
+    try {
+      switch (encoding) {
+        case content_encoding::DEFLATE:
+          res.body() = std::move(data);
+          res.set(http::field::content_encoding, "deflate");
+          break;
+        case content_encoding::GZIP:
+          res.body() = pinned_body::value_type{
+              std::make_shared<std::string const>(
+                  deflate_to_gzip(data.data_))};
+          res.set(http::field::content_encoding, "gzip");
+          break;
+        default:
+          res.body() = pinned_body::value_type{
+              std::make_shared<std::string const>(
+                  decompress_deflate(data.data_))};
+      }
       res.result(http::status::ok);
-    } else {
+    } catch (std::exception const& e) {
+      t_log("tile transcoding failed: {}", e.what());
+      res.body() = {};
+      res.erase(http::field::content_encoding);
+      res.erase(http::field::etag);
+      res.erase(http::field::cache_control);
+      res.result(http::status::internal_server_error);
+    }
+  };
+
+  auto const write_tile = [&](render_result const& result,
+                              content_encoding const encoding,
+                              response_t& res) {
+    if (result.tile_ == nullptr) {
+      res.erase(http::field::etag);
+      res.erase(http::field::cache_control);
+      res.result(result.status_);
+      if (result.status_ == http::status::service_unavailable) {
+        res.set(http::field::retry_after, "1");
+      }
+    } else if (result.tile_->empty()) {
       res.result(http::status::no_content);
+    } else {
+      write_tile_data(pinned_body::value_type{result.tile_}, encoding, res);
+    }
+  };
+
+  // nearest ancestor which is prepared or cached, scaled to the tile
+  auto const overzoom_fallback = [&](db_generation& gen, geo::tile const& tile)
+      -> std::optional<std::pair<geo::tile, tile_cache::value_t>> {
+    auto const& cache = gen.cache_;
+    auto const compressed = gen.render_ctx_.compress_result_;
+    try {
+      auto txn = gen.txn_pool_.acquire();
+      for (auto ancestor = tile; ancestor.z_ != 0;) {
+        ancestor = ancestor.parent();
+
+        tile_cache::value_t data;
+        if (!gen.is_rendered(ancestor)) {
+          if (auto const db_tile =
+                  txn->txn().get(txn->tiles_dbi(), tile_to_key(ancestor));
+              db_tile) {
+            data = std::make_shared<std::string const>(*db_tile);
+          }
+        } else if (cache != nullptr) {
+          data = cache->get(tile_to_key(ancestor));
+        }
+        if (data == nullptr) {
+          continue;
+        }
+        if (data->empty()) {
+          return std::pair{ancestor, std::move(data)};
+        }
+
+        auto mvt = overzoom_tile(
+            compressed ? decompress_deflate(*data) : *data, ancestor, tile);
+        if (compressed && !mvt.empty()) {
+          mvt = compress_deflate(mvt);
+        }
+        return std::pair{ancestor,
+                         std::make_shared<std::string const>(std::move(mvt))};
+      }
+    } catch (std::exception const& e) {
+      t_log("overzoom failed: {} ({})", tile, e.what());
+    }
+    return std::nullopt;
+  };
+
+  std::atomic_uint64_t renders_cancelled{0};
+  std::atomic_uint64_t renders_over_budget{0};
+  std::atomic_uint64_t overzoomed{0};
+
+  // after the render pool: flights of the renders it dropped from its queue
+  // keep their connections (callbacks) which must go before the io_contexts
+  std::vector<std::weak_ptr<db_generation>> open_generations{current};
+  auto const drop_flights = utl::make_finally([&] {
+    for (auto const& g : open_generations) {
+      if (auto const gen = g.lock(); gen != nullptr) {
+        gen->renders_.clear();
+      }
+    }
+  });
+
+  // must be destroyed first: queued tasks reference everything above
+  auto const render_threads = opt.render_threads_ != 0
+                                  ? opt.render_threads_
+                                  : std::thread::hardware_concurrency();
+  bounded_worker_pool render_pool{render_threads, opt.render_queue_size_};
+
+  auto const render_tile_async = [&](db_generation_ptr const& gen,
+                                     geo::tile const& tile,
+                                     content_encoding const encoding,
+                                     access_log_entry& entry, response_t& res,
+                                     cancel_token_ptr const& cancel,
+                                     done_fn_t const& done) {
+    auto const& cache = gen->cache_;
+    auto& renders = gen->renders_;
+    if (cache != nullptr) {
+      if (auto cached = cache->get(tile_to_key(tile)); cached != nullptr) {
+        entry.source_ = access_log_entry::source::CACHE;
+        write_tile({cached}, encoding, res);
+        done();
+        return;
+      }
+    }
+
+    // n distinguishes metatiles with the same root but different zoom
+    // (sliced tiles are cheap: no metatiles)
+    auto const root = tile.z_ > gen->render_ctx_.max_data_zoom_level_
+                          ? tile
+                          : metatile_root(tile, metatile_levels);
+    auto const key = tile_to_key(root, tile.z_ - root.z_);
+
+    auto const flight = renders.join(
+        key,
+        [&, gen, tile, encoding, cancel, done](metatile_result const& result) {
+          auto tile_result = result.get(tile);
+          entry.source_ = access_log_entry::source::RENDER;
+          entry.render_ns_ = tile_result.render_ns_;
+
+          // over budget or saturated: a coarser tile beats no tile
+          if (tile_result.tile_ == nullptr && opt.overzoom_fallback_ &&
+              !cancel->cancelled() &&
+              (tile_result.status_ == http::status::gateway_timeout ||
+               tile_result.status_ == http::status::service_unavailable)) {
+            if (auto fallback = overzoom_fallback(*gen, tile); fallback) {
+              ++overzoomed;
+              auto const& [ancestor, value] = *fallback;
+              entry.source_ = access_log_entry::source::OVERZOOM;
+              res.erase(http::field::etag);
+              res.set(http::field::cache_control, "no-cache");
+              res.set("X-Tile-Overzoom", fmt::format("{}/{}/{}", ancestor.z_,
+                                                     ancestor.x_, ancestor.y_));
+              tile_result = {value};
+            } else if (tile_result.status_ == http::status::gateway_timeout) {
+              tile_result.status_ = http::status::service_unavailable;
+            }
+          }
+
+          write_tile(tile_result, encoding, res);
+          done();
+        },
+        cancel.get());
+    if (flight == nullptr) {
+      return;  // already in flight, the running render will respond
+    }
+
+    auto const submitted = render_pool.try_submit([&, gen, tile, root,
+                                                   flight] {
+      auto const& cache = gen->cache_;
+      auto const& cancel = flight->cancel_->token_;
+      metatile_result result;
+      try {
+        throw_if_cancelled(cancel);  // gone while queued
+
+        auto const start = std::chrono::steady_clock::now();
+        if (root == tile) {
+          // a render may have finished between cache lookup and join
+          auto value =
+              cache != nullptr ? cache->get(tile_to_key(tile)) : nullptr;
+          if (value == nullptr) {
+            value = tile.z_ > gen->render_ctx_.max_data_zoom_level_
+                        ? render_sliced(*gen, gen->render_ctx_, tile, cancel)
+                        : render_tile(*gen, gen->render_ctx_, tile, cancel);
+          }
+          result.tiles_.emplace_back(tile, std::move(value));
+        } else {
+          result.tiles_ =
+              render_metatile(*gen, gen->render_ctx_, root, tile.z_, cancel);
+        }
+        result.render_ns_ = ns_since(start);
+
+        if (cache != nullptr) {
+          for (auto const& [t, value] : result.tiles_) {
+            cache->put(tile_to_key(t), value);
+          }
+        }
+      } catch (render_cancelled const&) {
+        ++renders_cancelled;
+        result = {{}, http::status::service_unavailable};
+      } catch (render_budget_exceeded const&) {
+        ++renders_over_budget;
+        result = {{}, http::status::gateway_timeout};
+
+        // finish without deadline so the next request hits the cache
+        if (cache != nullptr && opt.fallback_render_) {
+          render_pool.try_submit([&, gen, tile, root] {
+            auto& ctx = gen->unbounded_ctx_;
+            try {
+              if (root == tile) {
+                gen->cache_->put(
+                    tile_to_key(tile),
+                    render_tile(*gen, ctx, tile, never_cancelled()));
+              } else {
+                for (auto const& [t, value] : render_metatile(
+                         *gen, ctx, root, tile.z_, never_cancelled())) {
+                  gen->cache_->put(tile_to_key(t), value);
+                }
+              }
+            } catch (std::exception const& e) {
+              t_log("background render failed: {} ({})", tile, e.what());
+            }
+          });
+        }
+      } catch (std::exception const& e) {
+        t_log("render failed: {} ({})", tile, e.what());
+        result = {{}, http::status::internal_server_error};
+      }
+      gen->renders_.finish(flight, result);
+    });
+
+    if (!submitted) {
+      renders.finish(flight, {{}, http::status::service_unavailable});
+    }
+  };
+
+  auto const serve_tile = [&](db_generation_ptr const& gen, auto const& req,
+                              auto& res, geo::tile const& tile,
+                              access_log_entry& entry,
+                              cancel_token_ptr const& cancel,
+                              done_fn_t const& done) {
+    res.set(http::field::vary, "Accept-Encoding");
+    auto const encoding =
+        negotiate_content_encoding(req[http::field::accept_encoding]);
+    if (encoding == content_encoding::NOT_ACCEPTABLE) {
+      res.result(http::status::not_acceptable);
+      done();
+      return;
+    }
+
+    auto txn = gen->acquire_txn();
+    auto const etag = tile_etag(*gen, *txn, tile, encoding);
+    res.set(http::field::etag, etag);
+    res.set(http::field::cache_control,
+            fmt::format("public, max-age={}", gen->is_rendered(tile)
+                                                  ? opt.rendered_max_age_
+                                                  : opt.prepared_max_age_));
+    if (etag_matches(req[http::field::if_none_match], etag)) {
+      entry.source_ = access_log_entry::source::NOT_MODIFIED;
+      res.result(http::status::not_modified);
+      done();
+      return;
+    }
+
+    if (gen->is_rendered(tile)) {
+      txn.reset();
+      render_tile_async(gen, tile, encoding, entry, res, cancel, done);
+      return;
+    }
+
+    // prepared tile: send straight from the map, the lease pins the pages
+    // (as long as reader slots are left for that, else copy)
+    auto const db_tile = txn->txn().get(txn->tiles_dbi(), tile_to_key(tile));
+    if (db_tile) {
+      entry.source_ = access_log_entry::source::PREPARED;
+      auto pin = gen->txn_pool_.try_pin(std::move(txn));
+      write_tile_data(
+          pin != nullptr
+              ? pinned_body::value_type{*db_tile, std::move(pin)}
+              : pinned_body::value_type{
+                    std::make_shared<std::string const>(*db_tile)},
+          encoding, res);
+      done();
+      return;
+    }
+
+    // missing (seaside or empty): rendered, but not on the i/o thread
+    txn.reset();
+    auto const submitted = render_pool.try_submit([&, gen, tile, encoding,
+                                                   cancel, done] {
+      auto const start = std::chrono::steady_clock::now();
+      render_result result;
+      try {
+        throw_if_cancelled(*cancel);  // gone while queued
+        result.tile_ = render_tile(*gen, gen->unbounded_ctx_, tile, *cancel);
+      } catch (render_cancelled const&) {
+        ++renders_cancelled;
+        result.status_ = http::status::service_unavailable;
+      } catch (std::exception const& e) {
+        t_log("render failed: {} ({})", tile, e.what());
+        result.status_ = http::status::internal_server_error;
+      }
+      entry.source_ = access_log_entry::source::RENDER;
+      entry.render_ns_ = ns_since(start);
+      write_tile(result, encoding, res);
+      done();
+    });
+    if (!submitted) {
+      write_tile({nullptr, http::status::service_unavailable}, encoding, res);
+      done();
+    }
+  };
+
+  // Everything available (cache, prepared) is looked up with one transaction
+  // and cursor, the feature pack records of the remaining tiles as well. They
+  // are rendered in parallel: each worker takes the next unrendered tile.
+  auto const serve_batch = [&](db_generation_ptr const& gen, auto const& req,
+                               auto& res, cancel_token_ptr const& cancel,
+                               done_fn_t const& done) {
+    auto const& cache = gen->cache_;
+    auto const& ctx = gen->unbounded_ctx_;
+    auto tiles = parse_tile_batch(beast::buffers_to_string(req.body().data()),
+                                  opt.batch_max_tiles_);
+    if (!tiles) {
+      res.result(http::status::bad_request);
+      done();
+      return;
+    }
+
+    auto job = std::make_shared<tile_batch_job>();
+    job->tiles_ = std::move(*tiles);
+    job->results_.resize(job->tiles_.size());
+    job->packs_.resize(job->tiles_.size());
+    job->cancel_ = cancel;
+
+    // released before rendering: copy the prepared tiles
+    auto const txn = gen->txn_pool_.acquire();
+    for (auto i = 0ULL; i < job->tiles_.size(); ++i) {
+      auto const& tile = job->tiles_[i];
+      if (gen->is_rendered(tile)) {
+        if (cache != nullptr) {
+          if (auto cached = cache->get(tile_to_key(tile)); cached != nullptr) {
+            job->results_[i] = pinned_body::value_type{std::move(cached)};
+            continue;
+          }
+        }
+      } else if (auto const db_tile =
+                     txn->txn().get(txn->tiles_dbi(), tile_to_key(tile));
+                 db_tile) {
+        job->results_[i] = pinned_body::value_type{
+            std::make_shared<std::string const>(*db_tile)};
+        continue;
+      }
+
+      if (tile.z_ <= ctx.max_data_zoom_level_) {
+        pack_records_foreach(txn->features_cursor(), tile, [&](auto t, auto r) {
+          job->packs_[i].emplace_back(t, r);
+        });
+      }
+      job->to_render_.push_back(i);
+    }
+
+    auto const respond = [&res, done](tile_batch_job const& job) {
+      if (job.failed_) {
+        res.result(http::status::internal_server_error);
+      } else {
+        std::string body;
+        for (auto i = 0ULL; i < job.tiles_.size(); ++i) {
+          append_tile_frame(body, job.tiles_[i], job.results_[i].data_);
+        }
+        res.body() = pinned_body::value_type{
+            std::make_shared<std::string const>(std::move(body))};
+        res.set(http::field::content_type, "application/octet-stream");
+        res.result(http::status::ok);
+      }
+      done();
+    };
+
+    if (job->to_render_.empty()) {
+      respond(*job);
+      return;
+    }
+
+    auto const work = [&, gen, job, respond] {
+      auto const& cache = gen->cache_;
+      auto const& ctx = gen->unbounded_ctx_;
+      for (auto i = job->next_++; i < job->to_render_.size() && !job->failed_;
+           i = job->next_++) {
+        auto const& cancel = *job->cancel_;
+        auto const idx = job->to_render_[i];
+        auto const& tile = job->tiles_[idx];
+        try {
+          auto const render_from_packs = [&] {
+            return to_value(with_perf_counter([&](auto& pc) {
+              return get_tile(
+                  ctx, tile,
+                  [&](auto&& fn) {
+                    for (auto const& [t, r] : job->packs_[idx]) {
+                      fn(t, gen->pack_handle_.get(r));
+                    }
+                  },
+                  pc, cancel);
+            }));
+          };
+          auto value = tile.z_ > ctx.max_data_zoom_level_
+                           ? render_sliced(*gen, ctx, tile, cancel)
+                           : render_from_packs();
+          if (cache != nullptr) {
+            cache->put(tile_to_key(tile), value);
+          }
+          job->results_[idx] = pinned_body::value_type{std::move(value)};
+        } catch (render_cancelled const&) {
+          ++renders_cancelled;
+          job->failed_ = true;
+        } catch (std::exception const& e) {
+          t_log("render failed: {} ({})", tile, e.what());
+          job->failed_ = true;
+        }
+      }
+
+      if (--job->workers_ == 0) {
+        respond(*job);
+      }
+    };
+
+    auto const workers = std::min(job->to_render_.size(),
+                                  static_cast<size_t>(render_threads));
+    job->workers_ = workers;
+    for (auto i = 0ULL; i < workers; ++i) {
+      if (render_pool.try_submit(work)) {
+        continue;
+      }
+
+      if (i == 0) {
+        res.result(http::status::service_unavailable);
+        res.set(http::field::retry_after, "1");
+        done();
+      } else if ((job->workers_ -= workers - i) == 0) {
+        respond(*job);  // the submitted workers did all tiles
+      }
+      return;
     }
-    return true;
   };
 
-  auto const maybe_serve_glyphs = [&](auto const& req, auto& res) -> bool {
-    static regex_matcher matcher{"^\\/glyphs/(.+)$"};
-    auto const decoded_url = url_decode(req);
-    auto const match = matcher.match(decoded_url);
-    if (!match) {
-      return false;
+  std::atomic_uint64_t db_swaps{0};
+
+  // per generation values (cache, coalesced) restart with a new one
+  auto const serve_metrics = [&](auto& res) {
+    auto const gen = get_generation();
+    auto text = metrics.to_prometheus();
+    if (gen->cache_ != nullptr) {
+      auto const stats = gen->cache_->get_stats();
+      text += fmt::format(
+          "# TYPE tiles_cache_hits_total counter\n"
+          "tiles_cache_hits_total {}\n"
+          "# TYPE tiles_cache_misses_total counter\n"
+          "tiles_cache_misses_total {}\n"
+          "# TYPE tiles_cache_evictions_total counter\n"
+          "tiles_cache_evictions_total {}\n"
+          "# TYPE tiles_cache_entries gauge\n"
+          "tiles_cache_entries {}\n"
+          "# TYPE tiles_cache_bytes gauge\n"
+          "tiles_cache_bytes {}\n",
+          stats.hits_, stats.misses_, stats.evictions_, stats.entries_,
+          stats.size_);
     }
+    if (auto const& features = gen->unbounded_ctx_.feature_cache_;
+        features != nullptr) {
+      auto const stats = features->get_stats();
+      text += fmt::format(
+          "# TYPE tiles_feature_cache_hits_total counter\n"
+          "tiles_feature_cache_hits_total {}\n"
+          "# TYPE tiles_feature_cache_misses_total counter\n"
+          "tiles_feature_cache_misses_total {}\n"
+          "# TYPE tiles_feature_cache_bytes gauge\n"
+          "tiles_feature_cache_bytes {}\n",
+          stats.hits_, stats.misses_, stats.size_);
+    }
+    text += fmt::format(
+        "# TYPE tiles_ready gauge\n"
+        "tiles_ready {}\n"
+        "# TYPE tiles_db_generation gauge\n"
+        "tiles_db_generation {}\n"
+        "# TYPE tiles_db_swaps_total counter\n"
+        "tiles_db_swaps_total {}\n"
+        "# TYPE tiles_render_pending gauge\n"
+        "tiles_render_pending {}\n"
+        "# TYPE tiles_render_coalesced_total counter\n"
+        "tiles_render_coalesced_total {}\n"
+        "# TYPE tiles_render_cancelled_total counter\n"
+        "tiles_render_cancelled_total {}\n"
+        "# TYPE tiles_render_over_budget_total counter\n"
+        "tiles_render_over_budget_total {}\n"
+        "# TYPE tiles_overzoom_total counter\n"
+        "tiles_overzoom_total {}\n",
+        ready ? 1 : 0, gen->id_, db_swaps.load(), render_pool.pending(),
+        gen->renders_.coalesced_.load(),
+        renders_cancelled.load(), renders_over_budget.load(),
+        overzoomed.load());
 
+    res.body() = pinned_body::value_type{
+        std::make_shared<std::string const>(std::move(text))};
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+    res.result(http::status::ok);
+  };
+
+  auto const serve_glyphs = [&](auto& res, std::string const& name) {
     try {
-      auto const mem =
-          pbf_sdf_fonts_res::get_resource(std::string{match->at(1)});
-      res.body() =
-          std::string{reinterpret_cast<char const*>(mem.ptr_), mem.size_};
+      auto const mem = pbf_sdf_fonts_res::get_resource(name);
+      res.body() = {
+          {reinterpret_cast<char const*>(mem.ptr_), mem.size_}, nullptr};
       res.result(http::status::ok);
     } catch (std::out_of_range const&) {
       res.result(http::status::not_found);
     }
-    return true;
   };
 
-  auto const maybe_serve_file = [&](auto const& req, auto& res) -> bool {
-    static regex_matcher matcher{"^\\/(.+)$"};
-    auto const decoded_url = url_decode(req);
-    auto const match = matcher.match(decoded_url);
-    if (!match && req.target() != "/") {
-      res.result(http::status::not_found);
-      return false;
-    }
-
+  auto const serve_file = [&](auto& res, std::string const& fname) {
     bool found = false;
-    std::string fname(match ? match->at(1) : "index.html");
     if (!opt.res_dname_.empty()) {
       auto p = boost::filesystem::path{opt.res_dname_} / fname;
       if (boost::filesystem::exists(p)) {
-        utl::mmap_reader mem{p.string().c_str()};
-        res.body() = std::string{mem.m_.ptr(), mem.m_.size()};
+        auto mem = std::make_shared<utl::mmap_reader>(p.string().c_str());
+        res.body() = {{mem->m_.ptr(), mem->m_.size()}, mem};
         found = true;
       }
     }
@@ -261,8 +1386,8 @@ int run_tiles_server(int argc, char const** argv) {
     if (!found) {
       try {
         auto const mem = tiles_server_res::get_resource(fname);
-        res.body() =
-            std::string{reinterpret_cast<char const*>(mem.ptr_), mem.size_};
+        res.body() = {  // embedded: static lifetime
+            {reinterpret_cast<char const*>(mem.ptr_), mem.size_}, nullptr};
         found = true;
       } catch (std::out_of_range const&) {
         // tough luck
@@ -281,11 +1406,120 @@ int run_tiles_server(int argc, char const** argv) {
     } else {
       res.result(http::status::not_found);
     }
+  };
+
+  // Hot database swap on SIGHUP or (db_watch_interval) when the resolved path
+  // or modification time of the database changes. The new generation is
+  // opened (and warmed up) next to the current one, then new requests switch.
+  std::mutex reload_mutex;
+  std::condition_variable reload_cv;
+  auto reload_requested = false;
+
+#ifdef SIGHUP
+  net::signal_set hup{*iocs.front(), SIGHUP};
+  std::function<void()> const wait_for_hup = [&] {
+    hup.async_wait([&](boost::system::error_code const& ec, int) {
+      if (ec) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> l{reload_mutex};
+        reload_requested = true;
+      }
+      reload_cv.notify_all();
+      wait_for_hup();
+    });
+  };
+  wait_for_hup();
+#endif
+
+  // a database file must not be opened twice: closing the older environment
+  // would drop the POSIX locks of the newer one on the same lock file
+  auto const is_open = [&](std::string const& path) {
+    utl::erase_if(open_generations, [](auto const& g) { return g.expired(); });
+    return std::any_of(begin(open_generations), end(open_generations),
+                       [&](auto const& g) {
+                         auto const gen = g.lock();
+                         return gen != nullptr && gen->path_ == path;
+                       });
+  };
 
-    return true;
+  // joined on every exit (serve_forever may throw, e.g. address in use)
+  std::thread warm_up, reloader;
+  auto const stop_threads = [&] {
+    {
+      std::lock_guard<std::mutex> l{reload_mutex};
+      stopping = true;
+    }
+    reload_cv.notify_all();
+    for (auto* t : {&reloader, &warm_up}) {
+      if (t->joinable()) {
+        t->join();
+      }
+    }
   };
+  auto const join_threads = utl::make_finally([&] { stop_threads(); });
+
+  if (opt.warm_up_) {
+    warm_up = std::thread{[&] {
+      warm_up_db(*get_generation());
+      ready = true;  // do not stay unavailable: just not warm
+    }};
+  }
+
+  reloader = std::thread{[&, loaded = db_version(opt.db_fname_)]() mutable {
+    auto const interval = std::chrono::seconds{opt.db_watch_interval_};
+    auto seen = loaded;
+
+    std::unique_lock<std::mutex> lock{reload_mutex};
+    while (!stopping) {
+      auto const wake_up = [&] { return reload_requested || stopping; };
+      if (interval.count() == 0) {
+        reload_cv.wait(lock, wake_up);
+      } else {
+        reload_cv.wait_for(lock, interval, wake_up);
+      }
+      if (stopping) {
+        break;
+      }
 
-  serve_forever("0.0.0.0", opt.port_, [&](auto const& req, auto& res) {
+      auto const signalled = std::exchange(reload_requested, false);
+      lock.unlock();
+      try {
+        // watched: a changed version has to be stable for one interval
+        auto const version = db_version(opt.db_fname_);
+        auto const settled = version == seen;
+        seen = version;
+        auto const path = boost::filesystem::canonical(opt.db_fname_);
+        if ((signalled || (version != loaded && settled)) &&
+            is_open(path.string())) {
+          loaded = version;  // refused once, not on every check
+          t_log("database reload refused: {} is still open (deploy new "
+                "versions under a new name and switch the symlink)",
+                path.string());
+        } else if (signalled || (version != loaded && settled)) {
+          auto next =
+              std::make_shared<db_generation>(opt, get_generation()->id_ + 1);
+          if (opt.warm_up_) {
+            warm_up_db(*next);
+          }
+          open_generations.emplace_back(next);
+          std::atomic_store(&current, std::move(next));
+          loaded = version;
+          ++db_swaps;
+          t_log("database generation {} active: {}", get_generation()->id_,
+                get_generation()->path_);
+        }
+      } catch (std::exception const& e) {
+        t_log("database reload failed: {}", e.what());
+      }
+      lock.lock();
+    }
+  }};
+
+  serve_forever(iocs, opt, [&](auto const& req, auto& res,
+                               cancel_token_ptr const& cancel,
+                               done_fn_t const& done) {
     res.set(http::field::access_control_allow_origin, "*");
     res.set(http::field::access_control_allow_headers,
             "X-Requested-With, Content-Type, Accept, Authorization");
@@ -295,17 +1529,75 @@ int run_tiles_server(int argc, char const** argv) {
     switch (req.method()) {
       case http::verb::options: res.result(http::status::no_content); break;
       case http::verb::get:
-      case http::verb::head:
-        if (!(maybe_serve_tile(req, res) ||  //
-              maybe_serve_glyphs(req, res) ||  //
-              maybe_serve_file(req, res))) {
+      case http::verb::head: {
+        auto const route = route_url(req.target());
+        if (route.kind_ == url_route::kind::TILE) {
+          auto const start = std::chrono::steady_clock::now();
+          auto const entry = std::make_shared<access_log_entry>();
+          entry->tile_ = route.tile_;
+          serve_tile(get_generation(), req, res, route.tile_, *entry, cancel,
+                     [&, start, entry, done] {
+                       entry->duration_ns_ = ns_since(start);
+                       entry->status_ =
+                           static_cast<uint16_t>(res.result_int());
+                       entry->bytes_ = res.body().size();
+                       metrics.record_request(entry->tile_.z_,
+                                              entry->duration_ns_,
+                                              entry->bytes_);
+                       if (request_log != nullptr) {
+                         request_log->push(*entry);
+                       }
+                       done();
+                     });
+          return;  // responds asynchronously
+        }
+
+        if (route.kind_ == url_route::kind::METRICS) {
+          serve_metrics(res);
+          break;
+        }
+        if (route.kind_ == url_route::kind::HEALTH) {
+          res.set(http::field::cache_control, "no-store");
+          res.body() = pinned_body::value_type{
+              std::make_shared<std::string const>(ready ? "ok\n"
+                                                        : "warming up\n")};
+          res.result(ready ? http::status::ok
+                           : http::status::service_unavailable);
+          break;
+        }
+
+        std::string path;
+        if (route.kind_ == url_route::kind::NOT_FOUND ||
+            !url_decode(route.path_, path)) {
           res.result(http::status::not_found);
+        } else if (route.kind_ == url_route::kind::GLYPHS) {
+          serve_glyphs(res, path);
+        } else {
+          serve_file(res, path);
         }
         break;
+      }
+      case http::verb::post:
+        if (route_url(req.target()).kind_ == url_route::kind::BATCH) {
+          serve_batch(get_generation(), req, res, cancel, done);
+          return;  // responds asynchronously
+        }
+        res.result(http::status::method_not_allowed);
+        break;
       default: res.result(http::status::method_not_allowed);
     }
+    done();
   });
 
+  stop_threads();
+
+  if (auto const& cache = current->cache_; cache != nullptr) {
+    auto const stats = cache->get_stats();
+    t_log("tile cache: {} hits, {} misses, {} evictions, {} entries ({})",
+          stats.hits_, stats.misses_, stats.evictions_, stats.entries_,
+          printable_bytes{stats.size_});
+  }
+
   return 0;
 }
 
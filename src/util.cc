@@ -1,5 +1,8 @@
 #include "tiles/util.h"
 
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <regex>
 
 #include "zlib.h"
@@ -22,6 +25,174 @@ std::string compress_deflate(std::string const& input) {
   return buffer;
 }
 
+namespace {
+
+// window_bits: 15 = zlib, -15 = raw deflate, 15 + 32 = zlib or gzip
+template <typename Fn>
+void inflate_chunks(std::string_view const input, int const window_bits,
+                    Fn&& fn) {
+  z_stream strm{};
+  utl::verify(inflateInit2(&strm, window_bits) == Z_OK, "inflateInit failed");
+
+  strm.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));  // NOLINT
+  strm.avail_in = static_cast<uInt>(input.size());
+
+  std::array<char, 16 * 1024> buf;  // NOLINT
+  auto ret = Z_OK;
+  while (ret != Z_STREAM_END) {
+    strm.next_out = reinterpret_cast<Bytef*>(buf.data());
+    strm.avail_out = static_cast<uInt>(buf.size());
+
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+      inflateEnd(&strm);
+      throw utl::fail("inflate failed: {}", ret);
+    }
+    if (ret == Z_OK && strm.avail_in == 0 && strm.avail_out != 0) {
+      inflateEnd(&strm);
+      throw utl::fail("inflate failed: truncated input");
+    }
+
+    fn(std::string_view{buf.data(), buf.size() - strm.avail_out});
+  }
+  inflateEnd(&strm);
+}
+
+void append_le32(std::string& out, uint32_t const v) {
+  for (auto i = 0U; i < 4; ++i) {
+    out += static_cast<char>((v >> (8U * i)) & 0xFFU);
+  }
+}
+
+}  // namespace
+
+std::string decompress_deflate(std::string_view const input) {
+  std::string out;
+  inflate_chunks(input, 15 + 32,
+                 [&](std::string_view chunk) { out.append(chunk); });
+  return out;
+}
+
+std::string deflate_to_gzip(std::string_view const input) {
+  // zlib: 2 byte header, raw deflate data, 4 byte adler32
+  utl::verify(input.size() >= 6, "deflate_to_gzip: input too short");
+  auto const cmf = static_cast<uint8_t>(input[0]);
+  auto const flg = static_cast<uint8_t>(input[1]);
+  utl::verify((cmf & 0x0FU) == 8 && ((cmf << 8U) | flg) % 31 == 0 &&
+                  (flg & 0x20U) == 0,
+              "deflate_to_gzip: not a zlib stream");
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  uint32_t size = 0;
+  inflate_chunks(input, 15, [&](std::string_view chunk) {
+    crc = crc32(crc, reinterpret_cast<Bytef const*>(chunk.data()),
+                static_cast<uInt>(chunk.size()));
+    size += static_cast<uint32_t>(chunk.size());  // ISIZE is mod 2^32
+  });
+
+  auto const raw = input.substr(2, input.size() - 6);
+
+  std::string out;
+  out.reserve(10 + raw.size() + 8);
+  // magic, method deflate, no flags, no mtime, no extra flags, unknown os
+  out.append("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+  out.append(raw);
+  append_le32(out, static_cast<uint32_t>(crc));
+  append_le32(out, size);
+  return out;
+}
+
+content_encoding negotiate_content_encoding(std::string_view header) {
+  if (header.empty()) {
+    return content_encoding::IDENTITY;
+  }
+
+  auto const trim = [](std::string_view sv) {
+    while (!sv.empty() && (sv.front() == ' ' || sv.front() == '\t')) {
+      sv.remove_prefix(1);
+    }
+    while (!sv.empty() && (sv.back() == ' ' || sv.back() == '\t')) {
+      sv.remove_suffix(1);
+    }
+    return sv;
+  };
+
+  auto const iequals = [](std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(begin(a), end(a), begin(b), [](char x, char y) {
+             return std::tolower(static_cast<unsigned char>(x)) ==
+                    std::tolower(static_cast<unsigned char>(y));
+           });
+  };
+
+  // q-value in thousandths, malformed values count as 1
+  auto const parse_q = [](std::string_view q) -> int {
+    if (q.empty() || (q[0] != '0' && q[0] != '1')) {
+      return 1000;
+    }
+    auto value = (q[0] - '0') * 1000;
+    if (q.size() > 2 && q[1] == '.') {
+      auto scale = 100;
+      for (auto i = 2ULL; i < q.size() && scale != 0; ++i, scale /= 10) {
+        if (q[i] < '0' || q[i] > '9') {
+          break;
+        }
+        value += (q[i] - '0') * scale;
+      }
+    }
+    return std::min(value, 1000);
+  };
+
+  // unset: -1
+  int q_deflate = -1, q_gzip = -1, q_identity = -1, q_any = -1;
+  while (!header.empty()) {
+    auto const comma = header.find(',');
+    auto item = header.substr(0, comma);
+    header.remove_prefix(comma == std::string_view::npos ? header.size()
+                                                         : comma + 1);
+
+    auto q = 1000;
+    auto const semicolon = item.find(';');
+    if (semicolon != std::string_view::npos) {
+      auto params = trim(item.substr(semicolon + 1));
+      if (params.size() > 2 && (params[0] == 'q' || params[0] == 'Q') &&
+          params[1] == '=') {
+        q = parse_q(trim(params.substr(2)));
+      }
+      item = item.substr(0, semicolon);
+    }
+    item = trim(item);
+
+    if (iequals(item, "deflate")) {
+      q_deflate = q;
+    } else if (iequals(item, "gzip") || iequals(item, "x-gzip")) {
+      q_gzip = q;
+    } else if (iequals(item, "identity")) {
+      q_identity = q;
+    } else if (item == "*") {
+      q_any = q;
+    }
+  }
+
+  auto const resolve = [&](int const q) { return q != -1 ? q : q_any; };
+  q_deflate = resolve(q_deflate);
+  q_gzip = resolve(q_gzip);
+  // identity is acceptable unless excluded explicitly
+  q_identity = q_identity != -1 ? q_identity : (q_any == 0 ? 0 : 1);
+
+  auto const best = std::max({q_deflate, q_gzip, q_identity});
+  if (best <= 0) {
+    return content_encoding::NOT_ACCEPTABLE;
+  } else if (q_deflate == best) {
+    return content_encoding::DEFLATE;
+  } else if (q_gzip == best) {
+    return content_encoding::GZIP;
+  } else {
+    return content_encoding::IDENTITY;
+  }
+}
+
 struct regex_matcher::impl {
   explicit impl(std::string const& pattern) : regex_{pattern} {}
 
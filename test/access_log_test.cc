@@ -0,0 +1,54 @@
+#include "catch2/catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "tiles/access_log.h"
+
+using namespace tiles;
+
+TEST_CASE("access_log") {
+  auto const fname = std::string{"access_log_test.log"};
+  std::remove(fname.c_str());
+
+  {
+    access_log log{fname, 1024, 2};
+
+    access_log_entry e;
+    e.tile_ = geo::tile{511, 340, 10};
+    e.status_ = 200;
+    e.bytes_ = 1234;
+    e.duration_ns_ = 15000;
+    e.source_ = access_log_entry::source::CACHE;
+    for (auto i = 0; i < 4; ++i) {
+      log.push(e);  // sampled: every second one
+    }
+
+    e.status_ = 503;
+    e.source_ = access_log_entry::source::NONE;
+    log.push(e);  // errors are not sampled
+  }
+
+  std::ifstream in{fname};
+  std::stringstream ss;
+  ss << in.rdbuf();
+  auto const text = ss.str();
+
+  auto const count = [&](std::string const& needle) {
+    auto n = 0;
+    for (auto pos = text.find(needle); pos != std::string::npos;
+         pos = text.find(needle, pos + 1)) {
+      ++n;
+    }
+    return n;
+  };
+
+  CHECK(count("\n") == 3);
+  CHECK(count(
+            "tile=10/511/340 status=200 bytes=1234 duration_us=15 render_us=0 "
+            "source=cache\n") == 2);
+  CHECK(count("status=503") == 1);
+
+  std::remove(fname.c_str());
+}
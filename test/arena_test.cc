@@ -0,0 +1,62 @@
+#include "catch2/catch.hpp"
+
+#include <map>
+#include <string_view>
+#include <unordered_set>
+
+#include "tiles/arena.h"
+
+using namespace tiles;
+
+TEST_CASE("arena allocate") {
+  arena a;
+  CHECK(a.block_count() == 0);
+
+  auto const* c = static_cast<char*>(a.allocate(1, 1));
+  auto const* d = static_cast<double*>(a.allocate(sizeof(double), 8));
+  CHECK(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+  CHECK(reinterpret_cast<char const*>(d) > c);
+  CHECK(a.block_count() == 1);
+
+  a.allocate(arena::kBlockSize, 8);  // large: own block
+  CHECK(a.block_count() == 2);
+
+  for (auto i = 0; i < 8; ++i) {
+    a.allocate(arena::kBlockSize / 8, 8);
+  }
+  CHECK(a.block_count() == 3);
+
+  auto const str = a.copy("hello world");
+  CHECK(str == "hello world");
+  CHECK(a.copy("").empty());
+}
+
+TEST_CASE("arena containers") {
+  arena a;
+
+  std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<>,
+                     arena_allocator<uint64_t>>
+      set{arena_allocator<uint64_t>{a}};
+  for (auto i = 0ULL; i < 1000; ++i) {
+    set.insert(i % 100);
+  }
+  CHECK(set.size() == 100);
+
+  std::map<std::string_view, size_t, std::less<>,
+           arena_allocator<std::pair<std::string_view const, size_t>>>
+      map{arena_allocator<std::pair<std::string_view const, size_t>>{a}};
+  map.emplace(a.copy(std::string{"key"}), 1);
+  CHECK(map.find("key") != end(map));
+}
+
+TEST_CASE("arena block reuse") {
+  void const* first = nullptr;
+  {
+    arena a;
+    first = a.allocate(16, 16);
+  }
+  {
+    arena a;
+    CHECK(a.allocate(16, 16) == first);  // pooled block of the same thread
+  }
+}
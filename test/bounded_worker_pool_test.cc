@@ -0,0 +1,65 @@
+#include "catch2/catch.hpp"
+
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "tiles/util_parallel.h"
+
+using namespace tiles;
+
+TEST_CASE("bounded_worker_pool") {
+  SECTION("bounded backlog") {
+    bounded_worker_pool pool{1, 2};
+    CHECK(pool.pending() == 0);
+
+    std::promise<void> release;
+    std::promise<void> started;
+    auto released = release.get_future().share();
+    CHECK(pool.try_submit([&, released] {
+      started.set_value();
+      released.wait();
+    }));
+    started.get_future().wait();  // running: still pending
+
+    std::atomic_bool second_ran{false};
+    CHECK(pool.try_submit([&] { second_ran = true; }));
+    CHECK(pool.pending() == 2);
+
+    CHECK_FALSE(pool.try_submit([] {}));  // full
+    CHECK(pool.pending() == 2);
+
+    release.set_value();
+    while (pool.pending() != 0) {
+      std::this_thread::yield();
+    }
+    CHECK(second_ran);
+    CHECK(pool.try_submit([] {}));
+  }
+
+  SECTION("exceptions") {
+    bounded_worker_pool pool{1, 1};
+    CHECK(pool.try_submit([] { throw std::runtime_error{"test"}; }));
+    while (pool.pending() != 0) {
+      std::this_thread::yield();
+    }
+
+    std::promise<void> done;
+    CHECK(pool.try_submit([&] { done.set_value(); }));  // worker still alive
+    done.get_future().wait();
+  }
+
+  SECTION("queued tasks are dropped on destruction") {
+    auto const capture = std::make_shared<int>(0);
+    std::atomic_bool ran{false};
+    {
+      bounded_worker_pool pool{0, 4};  // no threads: tasks stay queued
+      CHECK(pool.try_submit([&ran, capture] { ran = true; }));
+      CHECK(pool.pending() == 1);
+      CHECK(capture.use_count() == 2);
+    }
+    CHECK_FALSE(ran);
+    CHECK(capture.use_count() == 1);
+  }
+}
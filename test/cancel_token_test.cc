@@ -0,0 +1,60 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/cancel_token.h"
+#include "tiles/single_flight.h"
+
+using namespace tiles;
+
+TEST_CASE("cancel_token") {
+  cancel_token token;
+  auto calls = 0;
+  token.on_cancel([&] { ++calls; });
+  CHECK_FALSE(token.cancelled());
+  CHECK_NOTHROW(throw_if_cancelled(token));
+
+  token.cancel();
+  token.cancel();
+  CHECK(token.cancelled());
+  CHECK(calls == 1);
+  CHECK_THROWS_AS(throw_if_cancelled(token), render_cancelled);
+
+  token.on_cancel([&] { ++calls; });  // already cancelled: immediately
+  CHECK(calls == 2);
+
+  CHECK_FALSE(never_cancelled().cancelled());
+}
+
+TEST_CASE("cancel_group") {
+  cancel_token a, b;
+  auto group = std::make_shared<cancel_group>();
+  group->add(&a);
+  group->add(&b);
+
+  a.cancel();
+  CHECK_FALSE(group->token_.cancelled());
+  b.cancel();
+  CHECK(group->token_.cancelled());
+
+  auto never = std::make_shared<cancel_group>();
+  never->add(nullptr);
+  never->add(&a);  // already cancelled
+  CHECK_FALSE(never->token_.cancelled());
+}
+
+TEST_CASE("single_flight_cancellation") {
+  single_flight<int, int> sf;
+  cancel_token a, b;
+
+  auto const flight = sf.join(1, [](int) {}, &a);
+  REQUIRE(flight != nullptr);
+  CHECK(sf.join(1, [](int) {}, &b) == nullptr);
+  auto const& cancel = flight->cancel_;
+
+  a.cancel();
+  CHECK_FALSE(cancel->token_.cancelled());
+  b.cancel();
+  CHECK(cancel->token_.cancelled());
+
+  sf.finish(flight, 0);
+  CHECK(sf.in_flight() == 0);
+}
@@ -1,5 +1,12 @@
 #include "catch2/catch.hpp"
 
+#include <random>
+
+#include "boost/geometry.hpp"
+
+#include "utl/erase_if.h"
+
+#include "tiles/fixed/algo/area.h"
 #include "tiles/fixed/algo/clip.h"
 
 using namespace tiles;
@@ -63,4 +70,126 @@ TEST_CASE("fixed point polyline") {
     fixed_polyline expected{{{{12, 10}, {12, 12}}}};
     CHECK(mpark::get<fixed_polyline>(result) == expected);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("fixed clip contained") {
+  fixed_box box{{10, 10}, {20, 20}};
+
+  CHECK(is_contained({{12, 12}, {18, 18}}, box));
+  CHECK_FALSE(is_contained({{10, 12}, {18, 18}}, box));
+  CHECK_FALSE(is_contained({{12, 12}, {18, 20}}, box));
+  CHECK_FALSE(is_contained({{0, 0}, {30, 30}}, box));
+
+  {
+    fixed_polyline const input{{{{12, 12}, {18, 18}}}};
+    fixed_geometry line = input;
+    correct_orientation(line);
+    REQUIRE(mpark::holds_alternative<fixed_polyline>(line));
+    CHECK(mpark::get<fixed_polyline>(line) == input);
+  }
+
+  {
+    fixed_simple_polygon simple;
+    simple.outer() = {{12, 12}, {18, 12}, {18, 18}, {12, 18}, {12, 12}};
+    fixed_geometry polygon = fixed_polygon{simple};
+    correct_orientation(polygon);
+
+    fixed_ring const expected{
+        {12, 12}, {12, 18}, {18, 18}, {18, 12}, {12, 12}};  // clockwise
+    REQUIRE(mpark::holds_alternative<fixed_polygon>(polygon));
+    REQUIRE(mpark::get<fixed_polygon>(polygon).size() == 1);
+    CHECK(mpark::get<fixed_polygon>(polygon).front().outer() == expected);
+  }
+}
+
+TEST_CASE("fixed polyline clip random") {
+  fixed_box box{{1000, 1000}, {2000, 2000}};
+
+  std::mt19937 gen{23};  // NOLINT
+  std::uniform_int_distribution<fixed_coord_t> dist{0, 3000};
+  for (auto i = 0; i < 1000; ++i) {
+    fixed_polyline input{fixed_line{}};
+    for (auto j = 0; j < 2 + i % 13; ++j) {
+      // duplicates and axis parallel segments on the box boundary
+      if (j % 5 == 4) {
+        input.back().push_back(input.back().back());
+      } else if (i % 3 == 0) {
+        input.back().emplace_back(1000 * (dist(gen) % 4), dist(gen));
+      } else {
+        input.back().emplace_back(dist(gen), dist(gen));
+      }
+    }
+
+    fixed_polyline expected;
+    boost::geometry::intersection(box, input, expected);
+    utl::erase_if(expected, [](auto const& line) { return line.size() < 2; });
+
+    auto const result = clip(fixed_geometry{input}, box);
+    if (expected.empty()) {
+      CHECK(mpark::holds_alternative<fixed_null>(result));
+    } else {
+      REQUIRE(mpark::holds_alternative<fixed_polyline>(result));
+      CHECK(mpark::get<fixed_polyline>(result) == expected);
+    }
+  }
+}
+
+TEST_CASE("fixed polygon clip") {
+  fixed_box box{{10, 10}, {20, 20}};
+
+  auto const make_polygon = [](fixed_ring outer,
+                               std::vector<fixed_ring> inners = {}) {
+    fixed_simple_polygon simple;
+    simple.outer() = std::move(outer);
+    simple.inners().assign(begin(inners), end(inners));
+    return fixed_geometry{fixed_polygon{simple}};
+  };
+  auto const clipped_area = [&](fixed_geometry const& input) {
+    auto const result = clip(input, box);
+    if (mpark::holds_alternative<fixed_null>(result)) {
+      return fixed_coord_t{0};
+    }
+    REQUIRE(mpark::holds_alternative<fixed_polygon>(result));
+    auto const envelope = boost::geometry::return_envelope<fixed_box>(
+        mpark::get<fixed_polygon>(result));
+    CHECK(boost::geometry::covered_by(envelope, box));
+    return area(result);
+  };
+
+  // disjoint / inside / covering
+  CHECK(clipped_area(make_polygon(
+            {{30, 30}, {30, 40}, {40, 40}, {40, 30}, {30, 30}})) == 0);
+  CHECK(clipped_area(make_polygon(
+            {{12, 12}, {12, 18}, {18, 18}, {18, 12}, {12, 12}})) == 36);
+  CHECK(clipped_area(make_polygon(
+            {{0, 0}, {0, 30}, {30, 30}, {30, 0}, {0, 0}})) == 100);
+
+  // partially overlapping, both orientations
+  CHECK(clipped_area(make_polygon(
+            {{5, 5}, {5, 15}, {15, 15}, {15, 5}, {5, 5}})) == 25);
+  CHECK(clipped_area(make_polygon(
+            {{5, 5}, {15, 5}, {15, 15}, {5, 15}, {5, 5}})) == 25);
+
+  // only touching the box
+  CHECK(clipped_area(make_polygon(
+            {{0, 0}, {0, 10}, {10, 10}, {10, 0}, {0, 0}})) == 0);
+
+  // holes: clipped, inside and outside the box
+  CHECK(clipped_area(make_polygon(
+            {{0, 0}, {0, 30}, {30, 30}, {30, 0}, {0, 0}},
+            {{{5, 5}, {15, 5}, {15, 15}, {5, 15}, {5, 5}},
+             {{16, 16}, {19, 16}, {19, 19}, {16, 19}, {16, 16}},
+             {{22, 22}, {28, 22}, {28, 28}, {22, 28}, {22, 22}}})) ==
+        100 - 25 - 9);
+
+  // concave: leaves and reenters the box
+  CHECK(clipped_area(make_polygon({{0, 12},
+                                   {0, 18},
+                                   {30, 18},
+                                   {30, 12},
+                                   {16, 12},
+                                   {16, 0},
+                                   {14, 0},
+                                   {14, 12},
+                                   {0, 12}})) == 60 + 2 * 2);
+}
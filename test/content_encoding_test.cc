@@ -0,0 +1,43 @@
+#include "catch2/catch.hpp"
+
+#include <string>
+
+#include "tiles/util.h"
+
+TEST_CASE("deflate_to_gzip") {
+  std::string test;
+  for (auto i = 0; i < 10000; ++i) {
+    test += std::to_string(i * i);
+  }
+
+  auto const deflated = tiles::compress_deflate(test);
+  CHECK(tiles::decompress_deflate(deflated) == test);
+
+  auto const gzipped = tiles::deflate_to_gzip(deflated);
+  REQUIRE(gzipped.size() == deflated.size() - 6 + 18);
+  CHECK(gzipped.substr(0, 3) == "\x1f\x8b\x08");
+  CHECK(tiles::decompress_deflate(gzipped) == test);
+
+  CHECK_THROWS(tiles::deflate_to_gzip(test));
+  CHECK_THROWS(tiles::decompress_deflate(deflated.substr(0, 20)));
+}
+
+TEST_CASE("negotiate_content_encoding") {
+  using tiles::content_encoding;
+  using tiles::negotiate_content_encoding;
+
+  CHECK(negotiate_content_encoding("") == content_encoding::IDENTITY);
+  CHECK(negotiate_content_encoding("gzip, deflate, br") ==
+        content_encoding::DEFLATE);
+  CHECK(negotiate_content_encoding("gzip") == content_encoding::GZIP);
+  CHECK(negotiate_content_encoding("GZIP;q=1.0, deflate;q=0.5") ==
+        content_encoding::GZIP);
+  CHECK(negotiate_content_encoding("br") == content_encoding::IDENTITY);
+  CHECK(negotiate_content_encoding("*") == content_encoding::DEFLATE);
+  CHECK(negotiate_content_encoding("deflate;q=0, *;q=0.1") ==
+        content_encoding::GZIP);
+  CHECK(negotiate_content_encoding("identity;q=0, br") ==
+        content_encoding::NOT_ACCEPTABLE);
+  CHECK(negotiate_content_encoding("*;q=0") ==
+        content_encoding::NOT_ACCEPTABLE);
+}
@@ -0,0 +1,35 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/db/database_stats.h"
+#include "tiles/db/tile_etag.h"
+#include "tiles/db/tile_index.h"
+
+#include "test_tile_database.h"
+
+using namespace tiles;
+
+TEST_CASE("prepared_tile_sizes") {
+  test_tile_database db;
+  {
+    auto txn = db.handle_.make_txn();
+    auto tiles_dbi = db.handle_.tiles_dbi(txn);
+    for (auto const& [tile, data] :
+         {std::pair{geo::tile{0, 0, 0}, std::string(3, 'a')},
+          std::pair{geo::tile{1, 0, 1}, std::string(5, 'b')},
+          std::pair{geo::tile{1, 1, 1}, std::string(7, 'c')}}) {
+      txn.put(tiles_dbi, tile_to_key(tile), data);
+      put_prepared_etag(txn, tiles_dbi, tile, data);
+    }
+    txn.commit();
+  }
+
+  auto txn = db.handle_.make_txn();
+  auto tiles_dbi = db.handle_.tiles_dbi(txn);
+  auto const sizes = prepared_tile_sizes(txn, tiles_dbi, 2);
+  REQUIRE(sizes.size() == 3);
+  CHECK(sizes[0] == std::vector<size_t>{3});
+  CHECK(sizes[1] == std::vector<size_t>{5, 7});
+  CHECK(sizes[2].empty());
+
+  CHECK_THROWS(prepared_tile_sizes(txn, tiles_dbi, 0));
+}
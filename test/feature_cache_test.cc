@@ -0,0 +1,113 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/db/feature_pack.h"
+#include "tiles/feature/deserialize.h"
+#include "tiles/feature/feature_cache.h"
+#include "tiles/feature/serialize.h"
+#include "tiles/fixed/convert.h"
+#include "tiles/fixed/io/serialize.h"
+#include "tiles/mvt/tile_spec.h"
+
+using namespace tiles;
+
+namespace {
+
+fixed_xy darmstadt(double const dlat, double const dlng) {
+  return latlng_to_fixed({49.87 + dlat, 8.65 + dlng});
+}
+
+std::vector<std::string> make_features() {
+  fixed_line line;
+  for (auto i = 0; i < 32; ++i) {
+    line.push_back(darmstadt(i * 0.0003, (i % 5) * 0.0002));
+  }
+
+  fixed_point const point{line[3]};
+
+  fixed_simple_polygon polygon;
+  for (auto i = 0; i < 12; ++i) {
+    polygon.outer().push_back(darmstadt(0.001 * (i / 3), 0.001 * (i % 3)));
+  }
+  polygon.outer().push_back(polygon.outer().front());
+  polygon.inners().push_back({darmstadt(0.001, 0.001),
+                              darmstadt(0.001, 0.0011),
+                              darmstadt(0.0011, 0.001)});  // degenerate
+
+  return {serialize_feature({1ULL, 0, {0, 20}, {{"a", "b"}}, point}),
+          serialize_feature({2ULL, 1, {0, 20}, {}, fixed_polyline{line}}),
+          serialize_feature({3ULL, 2, {14, 20}, {}, fixed_polygon{polygon}}),
+          serialize_feature({4ULL, 1, {0, 12}, {}, fixed_polyline{line}})};
+}
+
+std::string describe(std::optional<feature> const& f) {
+  if (!f) {
+    return "none";
+  }
+  auto str = std::to_string(f->id_) + "/" + std::to_string(f->layer_) + "/" +
+             std::to_string(f->meta_.size()) + "/";
+  if (!mpark::holds_alternative<fixed_null>(f->geometry_)) {
+    str += serialize(f->geometry_);
+  }
+  return str;
+}
+
+}  // namespace
+
+TEST_CASE("feature_cache") {
+  geo::tile const root{536, 347, 10};
+  auto const pack =
+      pack_features(root, {}, {pack_features(make_features())});
+  shared_metadata_decoder const decoder;
+  feature_cache cache{1024 * 1024, 1};
+
+  auto const render = [&](geo::tile const& tile) {
+    auto const box = tile_spec{tile}.draw_bounds_;
+
+    std::vector<std::string> expected;
+    unpack_features(root, pack, tile, [&](auto const& str) {
+      expected.push_back(
+          describe(deserialize_feature(str, decoder, box, tile.z_)));
+    });
+
+    std::vector<std::string> actual;
+    CHECK(unpack_spans(root, pack, tile, tile.z_, [&](auto const& span) {
+      auto const cached = get_span(cache, span, decoder);
+      for (auto const& f : cached->features_) {
+        actual.push_back(describe(materialize_feature(f, box, tile.z_)));
+      }
+      return cached->span_size_;
+    }));
+    CHECK(expected == actual);
+    return std::count(begin(actual), end(actual), "none") !=
+           static_cast<int64_t>(actual.size());
+  };
+
+  auto rendered = 0;
+  for (auto z = 10U; z <= 16U; ++z) {
+    for (auto const& tile : root.range_on_z(z)) {
+      rendered += render(tile) ? 1 : 0;
+    }
+  }
+  CHECK(rendered >= 7);  // at least one tile per level
+
+  auto const stats = cache.get_stats();
+  CHECK(stats.misses_ > 0);
+  CHECK(stats.hits_ > stats.misses_);
+  CHECK(stats.evictions_ == 0);
+  CHECK(stats.size_ > 0);
+
+  render(root);
+  CHECK(cache.get_stats().misses_ == stats.misses_);
+
+  feature_cache tiny{1, 1};  // everything too large
+  auto const span_count = [&] {
+    auto n = 0;
+    unpack_spans(root, pack, root, root.z_, [&](auto const& span) {
+      ++n;
+      return get_span(tiny, span, decoder)->span_size_;
+    });
+    return n;
+  };
+  CHECK(span_count() > 0);
+  CHECK(tiny.get_stats().entries_ == 0);
+}
@@ -67,6 +67,11 @@ TEST_CASE("feature_pack") {
       tiles::unpack_features(geo::tile{}, pack, geo::tile{},
                              [&](auto const&) { ++count; });
       CHECK(count == 2);
+
+      // metatile query: root tile, features up to z12
+      tiles::unpack_features({536, 347, 10}, pack, {536, 347, 10}, 12,
+                             [&](auto const&) { ++count; });
+      CHECK(count == 3);
     }
   }
 }
@@ -0,0 +1,102 @@
+#include "catch2/catch.hpp"
+
+#include <random>
+
+#include "tiles/db/feature_pack.h"
+#include "tiles/feature/feature_cache.h"
+#include "tiles/feature/metadata.h"
+#include "tiles/feature/serialize.h"
+#include "tiles/get_tile.h"
+#include "tiles/mvt/tile_spec.h"
+#include "tiles/perf_counter.h"
+
+using namespace tiles;
+
+namespace {
+
+// lines, points and polygons in the root tile, many cross child borders
+std::vector<std::string> make_features(geo::tile const& root) {
+  auto const& bounds = tile_spec{root}.insert_bounds_;
+  auto const size = bounds.max_corner().x() - bounds.min_corner().x();
+
+  std::mt19937 gen{42};  // NOLINT
+  std::uniform_int_distribution<fixed_coord_t> dist{0, size - 1};
+  auto const random_point = [&] {
+    return fixed_xy{bounds.min_corner().x() + dist(gen),
+                    bounds.min_corner().y() + dist(gen)};
+  };
+
+  std::vector<std::string> features;
+  for (auto i = 0ULL; i < 120; ++i) {
+    fixed_geometry geometry;
+    switch (i % 3) {
+      case 0: geometry = fixed_point{random_point()}; break;
+      case 1: {
+        fixed_line line{random_point()};
+        for (auto j = 0ULL; j < 2 + i % 13; ++j) {
+          // short segments: some lines stay inside a single child
+          auto const dx = (dist(gen) - size / 2) / (1 + i % 7);
+          auto const dy = (dist(gen) - size / 2) / (1 + i % 7);
+          line.emplace_back(line.back().x() + dx, line.back().y() + dy);
+        }
+        geometry = fixed_polyline{std::move(line)};
+      } break;
+      default: {
+        auto const a = random_point();
+        auto const d = size / static_cast<fixed_coord_t>(4 + i % 29);
+        fixed_simple_polygon polygon{{a,
+                                      {a.x(), a.y() + d},
+                                      {a.x() + d, a.y() + d},
+                                      {a.x() + d, a.y()},
+                                      a}};
+        boost::geometry::correct(polygon);
+        geometry = fixed_polygon{std::move(polygon)};
+      }
+    }
+
+    features.push_back(serialize_feature(
+        {i,
+         i % 2,
+         {static_cast<uint32_t>(i % 4 == 3 ? 12 : 0), 20},
+         {{"name", encode_string("f" + std::to_string(i % 5))}},
+         std::move(geometry)}));
+  }
+  return features;
+}
+
+}  // namespace
+
+TEST_CASE("get_metatile") {
+  geo::tile const root{536, 347, 10};
+  auto const features = make_features(root);
+
+  render_ctx ctx;
+  ctx.layer_names_ = {"a", "b"};
+  ctx.compress_result_ = false;
+
+  auto cached_ctx = ctx;
+  cached_ctx.feature_cache_ = std::make_shared<feature_cache>(1024 * 1024, 1);
+
+  null_perf_counter pc;
+  auto const check = [&](std::string const& pack) {
+    auto const foreach_pack = [&](auto&& fn) { fn(root, pack); };
+    for (auto z = root.z_; z <= root.z_ + 3; ++z) {
+      auto const metatile = get_metatile(ctx, root, z, foreach_pack, pc);
+      REQUIRE(metatile.size() == 1ULL << (2 * (z - root.z_)));
+      CHECK(get_metatile(cached_ctx, root, z, foreach_pack, pc) == metatile);
+
+      auto rendered = 0;
+      for (auto const& [tile, result] : metatile) {
+        CHECK(result == get_tile(ctx, tile, foreach_pack, pc));
+        rendered += result.has_value() ? 1 : 0;
+      }
+      CHECK(rendered > 0);
+    }
+  };
+
+  SECTION("quad tree") {
+    check(pack_features(root, {}, {pack_features(features)}));
+    CHECK(cached_ctx.feature_cache_->get_stats().hits_ > 0);
+  }
+  SECTION("no quad tree") { check(pack_features(features)); }
+}
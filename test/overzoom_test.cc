@@ -0,0 +1,151 @@
+#include "catch2/catch.hpp"
+
+#include <tuple>
+#include <vector>
+
+#include "protozero/pbf_builder.hpp"
+#include "protozero/pbf_message.hpp"
+
+#include "tiles/get_tile.h"
+#include "tiles/mvt/overzoom.h"
+#include "tiles/mvt/tags.h"
+
+namespace pz = protozero;
+namespace ttm = tiles::tags::mvt;
+
+namespace {
+
+std::string make_feature(uint64_t id, ttm::GeomType type,
+                         std::vector<uint32_t> const& geometry) {
+  std::string buf;
+  pz::pbf_builder<ttm::Feature> pb{buf};
+  pb.add_uint64(ttm::Feature::optional_uint64_id, id);
+  std::vector<uint32_t> tags{0, 0};
+  pb.add_packed_uint32(ttm::Feature::packed_uint32_tags, begin(tags),
+                       end(tags));
+  pb.add_enum(ttm::Feature::optional_GeomType_type, type);
+  pb.add_packed_uint32(ttm::Feature::packed_uint32_geometry, begin(geometry),
+                       end(geometry));
+  return buf;
+}
+
+// (layer name, feature id, geometry commands)
+using decoded_t = std::vector<std::tuple<std::string, uint64_t,
+                                         std::vector<uint32_t>, std::string>>;
+
+decoded_t decode(std::string const& tile) {
+  decoded_t result;
+  pz::pbf_message<ttm::Tile> tile_msg{tile.data(), tile.size()};
+  while (tile_msg.next(ttm::Tile::repeated_Layer_layers)) {
+    auto const layer = tile_msg.get_view();
+    std::string name, key;
+    pz::pbf_message<ttm::Layer> layer_msg{layer.data(), layer.size()};
+    while (layer_msg.next()) {
+      switch (layer_msg.tag()) {
+        case ttm::Layer::required_string_name:
+          name = layer_msg.get_string();
+          break;
+        case ttm::Layer::repeated_string_keys:
+          key = layer_msg.get_string();
+          break;
+        case ttm::Layer::repeated_Feature_features: {
+          auto const feature = layer_msg.get_view();
+          uint64_t id = 0;
+          std::vector<uint32_t> geometry;
+          pz::pbf_message<ttm::Feature> msg{feature.data(), feature.size()};
+          while (msg.next()) {
+            if (msg.tag() == ttm::Feature::optional_uint64_id) {
+              id = msg.get_uint64();
+            } else if (msg.tag() == ttm::Feature::packed_uint32_geometry) {
+              auto const range = msg.get_packed_uint32();
+              geometry.assign(range.begin(), range.end());
+            } else {
+              msg.skip();
+            }
+          }
+          result.emplace_back(name, id, geometry, "");
+        } break;
+        default: layer_msg.skip();
+      }
+    }
+    for (auto& r : result) {
+      std::get<3>(r) = key;
+    }
+  }
+  return result;
+}
+
+uint32_t zz(int32_t v) { return pz::encode_zigzag32(v); }
+
+std::string make_test_tile() {
+  std::string layer;
+  {
+    pz::pbf_builder<ttm::Layer> pb{layer};
+    pb.add_uint32(ttm::Layer::required_uint32_version, 2);
+    pb.add_string(ttm::Layer::required_string_name, "road");
+    pb.add_uint32(ttm::Layer::optional_uint32_extent, 4096);
+    pb.add_message(ttm::Layer::repeated_Feature_features,
+                   make_feature(1, ttm::GeomType::POINT,
+                                {2U << 3U | 1U, zz(3000), zz(3000), zz(-2900),
+                                 zz(-2900)}));
+    pb.add_message(ttm::Layer::repeated_Feature_features,
+                   make_feature(2, ttm::GeomType::LINESTRING,
+                                {9, zz(2048), zz(2048), 1U << 3U | 2U,
+                                 zz(1952), zz(1952)}));
+    pb.add_message(ttm::Layer::repeated_Feature_features,
+                   make_feature(3, ttm::GeomType::POINT, {9, zz(10), zz(10)}));
+    pb.add_string(ttm::Layer::repeated_string_keys, "highway");
+  }
+
+  std::string tile;
+  {
+    pz::pbf_builder<ttm::Tile> pb{tile};
+    pb.add_message(ttm::Tile::repeated_Layer_layers, layer);
+  }
+  return tile;
+}
+
+}  // namespace
+
+TEST_CASE("overzoom_tile") {
+  auto const ancestor = make_test_tile();
+
+  // lower right quarter: offset 2048, scale 2
+  auto const child = tiles::overzoom_tile(ancestor, {0, 0, 1}, {1, 1, 2});
+  auto const decoded = decode(child);
+  REQUIRE(decoded.size() == 2);
+
+  CHECK(std::get<0>(decoded[0]) == "road");
+  CHECK(std::get<1>(decoded[0]) == 1);
+  CHECK(std::get<2>(decoded[0]) ==
+        std::vector<uint32_t>{9, zz(1904), zz(1904)});
+  CHECK(std::get<3>(decoded[0]) == "highway");
+
+  CHECK(std::get<1>(decoded[1]) == 2);
+  CHECK(std::get<2>(decoded[1]) ==
+        std::vector<uint32_t>{9, zz(0), zz(0), 10, zz(3904), zz(3904)});
+
+  // no features in this part of the ancestor
+  CHECK(tiles::overzoom_tile(ancestor, {0, 0, 1}, {1, 0, 3}).empty());
+
+  CHECK_THROWS(tiles::overzoom_tile(ancestor, {0, 0, 1}, {2, 0, 2}));
+}
+
+TEST_CASE("slice_tile") {
+  tiles::render_ctx ctx;
+  ctx.compress_result_ = false;
+  ctx.max_data_zoom_level_ = 1;
+
+  CHECK(tiles::data_tile(ctx, {1, 0, 1}) == geo::tile{1, 0, 1});
+  CHECK(tiles::data_tile(ctx, {7, 2, 3}) == geo::tile{1, 0, 1});
+
+  tiles::null_perf_counter pc;
+  auto const ancestor = make_test_tile();
+  auto const child =
+      tiles::slice_tile(ctx, {0, 0, 1}, ancestor, {1, 1, 2}, pc);
+  REQUIRE(child.has_value());
+  CHECK(*child == tiles::overzoom_tile(ancestor, {0, 0, 1}, {1, 1, 2}));
+
+  CHECK(!tiles::slice_tile(ctx, {0, 0, 1}, ancestor, {1, 0, 3}, pc));
+  CHECK(!tiles::slice_tile(ctx, {0, 0, 1}, "", {1, 1, 2}, pc));
+}
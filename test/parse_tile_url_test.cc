@@ -0,0 +1,58 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/parse_tile_url.h"
+
+using namespace tiles;
+
+TEST_CASE("parse_tile_path") {
+  CHECK(parse_tile_path("/0/0/0.mvt") == geo::tile{0, 0, 0});
+  CHECK(parse_tile_path("/10/511/340.mvt") == geo::tile{511, 340, 10});
+
+  CHECK_FALSE(parse_tile_path("/0/0/0.mvtx").has_value());
+  CHECK_FALSE(parse_tile_path("0/0/0.mvt").has_value());
+  CHECK_FALSE(parse_tile_path("/0/0/.mvt").has_value());
+  CHECK_FALSE(parse_tile_path("/0/-1/0.mvt").has_value());
+  CHECK_FALSE(parse_tile_path("/1/2/0.mvt").has_value());  // x out of range
+  CHECK_FALSE(parse_tile_path("/99/0/0.mvt").has_value());
+  CHECK_FALSE(parse_tile_path("/0/0/99999999999999999999.mvt").has_value());
+}
+
+TEST_CASE("parse_tile_url") {
+  CHECK(parse_tile_url("http://localhost:8888/3/4/5.mvt") ==
+        geo::tile{4, 5, 3});
+  CHECK_FALSE(parse_tile_url("/4/5.mvt").has_value());
+}
+
+TEST_CASE("route_url") {
+  auto const tile = route_url("/3/4/5.mvt?v=2");
+  CHECK(tile.kind_ == url_route::kind::TILE);
+  CHECK(tile.tile_ == geo::tile{4, 5, 3});
+
+  auto const glyphs = route_url("/glyphs/Noto%20Sans/0-255.pbf");
+  CHECK(glyphs.kind_ == url_route::kind::GLYPHS);
+  CHECK(glyphs.path_ == "Noto%20Sans/0-255.pbf");
+
+  auto const index = route_url("/");
+  CHECK(index.kind_ == url_route::kind::FILE);
+  CHECK(index.path_ == "index.html");
+
+  auto const file = route_url("/style.css");
+  CHECK(file.kind_ == url_route::kind::FILE);
+  CHECK(file.path_ == "style.css");
+
+  CHECK(route_url("/metrics").kind_ == url_route::kind::METRICS);
+  CHECK(route_url("/health").kind_ == url_route::kind::HEALTH);
+  CHECK(route_url("/health?lb=1").kind_ == url_route::kind::HEALTH);
+  CHECK(route_url("/batch").kind_ == url_route::kind::BATCH);
+  CHECK(route_url("/99/0/0.mvt").kind_ == url_route::kind::FILE);
+  CHECK(route_url("*").kind_ == url_route::kind::NOT_FOUND);
+}
+
+TEST_CASE("url_decode") {
+  std::string out;
+  CHECK(url_decode("Noto%20Sans+Bold%2c", out));
+  CHECK(out == "Noto Sans Bold,");
+
+  CHECK_FALSE(url_decode("abc%2", out));
+  CHECK_FALSE(url_decode("abc%zz", out));
+}
@@ -0,0 +1,42 @@
+#include "catch2/catch.hpp"
+
+#include <thread>
+
+#include "tiles/perf_metrics.h"
+
+using namespace tiles;
+
+TEST_CASE("histogram buckets") {
+  CHECK(histogram::bucket_idx(0) == 0);
+  CHECK(histogram::bucket_idx(1023) == 0);
+  CHECK(histogram::bucket_idx(1024) == 1);
+  CHECK(histogram::bucket_idx(2047) == 1);
+  CHECK(histogram::bucket_idx(2048) == 2);
+  CHECK(histogram::bucket_idx(~0ULL) == histogram::kBucketCount - 1);
+}
+
+TEST_CASE("perf_metrics merge threads") {
+  perf_metrics metrics;
+
+  auto const work = [&] {
+    metrics_perf_counter pc{metrics.local()};
+    pc.append<perf_task::RESULT_SIZE>(100);
+    metrics.record_request(3, 5000, 100);
+  };
+  std::thread t1{work}, t2{work};
+  t1.join();
+  t2.join();
+  work();
+
+  CHECK(metrics.threads_.size() == 3);
+  CHECK(&metrics.local() == &metrics.local());
+
+  auto const text = metrics.to_prometheus();
+  CHECK(text.find("tiles_tile_size_bytes_count{} 3\n") != std::string::npos);
+  CHECK(text.find("tiles_requests_total{z=\"3\"} 3\n") != std::string::npos);
+  CHECK(text.find("tiles_response_bytes_total{z=\"3\"} 300\n") !=
+        std::string::npos);
+  CHECK(text.find("tiles_request_duration_seconds_bucket{z=\"3\",le=\"+Inf\"}"
+                  " 3\n") != std::string::npos);
+  CHECK(text.find("z=\"4\"") == std::string::npos);
+}
@@ -0,0 +1,43 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/db/read_txn_pool.h"
+
+#include "test_tile_database.h"
+
+using namespace tiles;
+
+TEST_CASE("read_txn_pool") {
+  test_tile_database db;
+  read_txn_pool pool{db.handle_, 2};
+
+  auto a = pool.acquire();
+  auto b = pool.acquire();
+  CHECK(a != b);
+
+  auto pin_a = pool.try_pin(a);
+  auto pin_b = pool.try_pin(b);
+  REQUIRE(pin_a != nullptr);
+  REQUIRE(pin_b != nullptr);
+  CHECK(pool.pinned() == 2);
+
+  auto c = pool.acquire();
+  CHECK(pool.try_pin(c) == nullptr);  // over the cap: copy instead
+  CHECK(pool.pinned() == 2);
+
+  // the pin keeps the transaction out of the pool
+  auto* const ptr_a = a.get();
+  a.reset();
+  CHECK(pool.idle_.empty());
+  pin_a.reset();
+  CHECK(pool.pinned() == 1);
+  REQUIRE(pool.idle_.size() == 1);
+  CHECK(pool.idle_.front().get() == ptr_a);
+
+  auto pin_c = pool.try_pin(c);
+  CHECK(pin_c != nullptr);
+  CHECK(pool.pinned() == 2);
+
+  pin_b.reset();
+  pin_c.reset();
+  CHECK(pool.pinned() == 0);
+}
@@ -0,0 +1,103 @@
+#include "catch2/catch.hpp"
+
+#include <string>
+
+#include "tiles/single_flight.h"
+
+using namespace tiles;
+
+TEST_CASE("single_flight") {
+  single_flight<int, std::string> sf;
+
+  std::vector<std::string> results;
+  auto const cb = [&](std::string const& s) { results.push_back(s); };
+
+  auto const one = sf.join(1, cb);
+  CHECK(one != nullptr);
+  CHECK(sf.join(1, cb) == nullptr);
+  auto const two = sf.join(2, cb);
+  CHECK(two != nullptr);
+  CHECK(sf.join(1, cb) == nullptr);
+  CHECK(sf.in_flight() == 2);
+  CHECK(sf.coalesced_ == 2);
+
+  sf.finish(one, "one");
+  CHECK(results == std::vector<std::string>{"one", "one", "one"});
+  CHECK(sf.in_flight() == 1);
+
+  auto const uno = sf.join(1, cb);  // new flight after finish
+  CHECK(uno != nullptr);
+
+  sf.finish(two, "two");
+  sf.finish(uno, "uno");
+  CHECK(results ==
+        std::vector<std::string>{"one", "one", "one", "two", "uno"});
+  CHECK(sf.in_flight() == 0);
+
+  CHECK_THROWS(sf.finish(uno, "again"));
+  CHECK_THROWS(sf.finish(nullptr, "none"));
+}
+
+TEST_CASE("single_flight_cancelled") {
+  single_flight<int, std::string> sf;
+
+  std::vector<std::string> results;
+  auto const cb = [&](std::string const& s) { results.push_back(s); };
+
+  cancel_token a, b, c;
+  auto const abandoned = sf.join(1, cb, &a);
+  REQUIRE(abandoned != nullptr);
+  CHECK(sf.join(1, cb, &b) == nullptr);
+
+  a.cancel();
+  CHECK(sf.join(1, cb, &c) == nullptr);  // still wanted by b
+  c.cancel();
+  CHECK_FALSE(abandoned->cancel_->token_.cancelled());
+  b.cancel();
+  CHECK(abandoned->cancel_->token_.cancelled());
+
+  // do not wait for the abandoned flight: start a new one
+  auto const fresh = sf.join(1, cb);
+  REQUIRE(fresh != nullptr);
+  CHECK(fresh != abandoned);
+  CHECK_FALSE(fresh->cancel_->token_.cancelled());
+  CHECK(sf.join(1, cb) == nullptr);
+  CHECK(sf.in_flight() == 1);
+
+  sf.finish(abandoned, "cancelled");
+  CHECK(results == std::vector<std::string>(3, "cancelled"));
+  CHECK(sf.in_flight() == 1);  // the new flight is still running
+
+  sf.finish(fresh, "fresh");
+  CHECK(results.size() == 5);
+  CHECK(results.back() == "fresh");
+  CHECK(sf.in_flight() == 0);
+}
+
+TEST_CASE("single_flight_clear") {
+  single_flight<int, std::string> sf;
+
+  std::vector<std::string> results;
+  auto const cb = [&](std::string const& s) { results.push_back(s); };
+
+  auto alive = std::make_shared<int>(0);
+  std::weak_ptr<int> const weak = alive;
+  auto const leader =
+      sf.join(1, [&, alive = std::move(alive)](auto const& s) { cb(s); });
+  REQUIRE(leader != nullptr);
+  CHECK(sf.join(1, cb) == nullptr);
+
+  sf.clear();  // e.g. the computation was dropped
+  CHECK(sf.in_flight() == 0);
+  CHECK(weak.expired());  // callbacks (and their captures) are released
+
+  auto const next = sf.join(1, cb);
+  CHECK(next != nullptr);
+
+  sf.finish(leader, "dropped");  // no effect
+  CHECK(results.empty());
+  CHECK(sf.in_flight() == 1);
+
+  sf.finish(next, "next");
+  CHECK(results == std::vector<std::string>{"next"});
+}
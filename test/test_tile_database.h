@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "tiles/db/tile_database.h"
+
+namespace tiles {
+
+// Temporary tile database (in the working directory) for tests.
+struct test_tile_database {
+  struct temp_file {
+    ~temp_file() {
+      std::remove(path_.c_str());
+      std::remove((path_ + "-lock").c_str());
+    }
+    std::string path_;
+  };
+
+  test_tile_database()
+      : file_{"tiles-test-" + std::to_string(std::random_device{}()) +
+              ".mdb"},
+        env_{make_tile_database(file_.path_.c_str(), 16ULL * 1024 * 1024)},
+        handle_{env_} {}
+
+  test_tile_database(test_tile_database const&) = delete;
+  test_tile_database(test_tile_database&&) = delete;
+  test_tile_database& operator=(test_tile_database const&) = delete;
+  test_tile_database& operator=(test_tile_database&&) = delete;
+  ~test_tile_database() = default;
+
+  temp_file file_;  // removed after the environment is closed
+  lmdb::env env_;
+  tile_db_handle handle_;
+};
+
+}  // namespace tiles
@@ -0,0 +1,59 @@
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+
+#include "tiles/tile_batch.h"
+
+using namespace tiles;
+
+TEST_CASE("parse_tile_batch") {
+  auto const tiles = parse_tile_batch("1/0/1\r\n\n0/0/0\n1/0/1\n", 10);
+  REQUIRE(tiles.has_value());
+  CHECK(*tiles == std::vector<geo::tile>{{0, 1, 1}, {0, 0, 0}});
+
+  CHECK(parse_tile_batch("", 10) == std::vector<geo::tile>{});
+
+  auto const bbox = parse_tile_batch("0/0/0\nbbox -10,-10.5,10,10 0-1", 10);
+  REQUIRE(bbox.has_value());
+  CHECK(bbox->size() == 5);
+  CHECK(bbox->front() == geo::tile{0, 0, 0});
+
+  CHECK_FALSE(parse_tile_batch("1/2/0", 10).has_value());  // x out of range
+  CHECK_FALSE(parse_tile_batch("1/0/0.mvt", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("0/0/0\n1/0/0\n1/1/0", 2).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,49.8,8.7 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.7,49.8,8.5,50.1 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,49.8,8.7,50.1 11-10", 10).has_value());
+
+  auto const world = parse_tile_batch("bbox -180,-90,180,90 0-2", 100);
+  REQUIRE(world.has_value());
+  CHECK(world->size() == 1 + 4 + 16);
+  CHECK(std::all_of(begin(*world), end(*world), [](auto const& t) {
+    return t.x_ < (1U << t.z_) && t.y_ < (1U << t.z_);
+  }));
+
+  CHECK_FALSE(parse_tile_batch("bbox nan,49.8,8.7,50.1 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,-inf,8.7,50.1 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,49.8,1e999,50.1 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 0x8,49.8,8.7,50.1 10", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox -181,49.8,8.7,50.1 0", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,49.8,180.5,50.1 0", 10).has_value());
+  CHECK_FALSE(parse_tile_batch("bbox 8.5,-91,8.7,50.1 0", 10).has_value());
+}
+
+TEST_CASE("tile_frames") {
+  std::string buf;
+  append_tile_frame(buf, {1, 2, 3}, "abc");
+  append_tile_frame(buf, {0, 0, 0}, "");
+
+  std::vector<std::pair<geo::tile, std::string>> frames;
+  CHECK(for_each_tile_frame(buf, [&](auto const& tile, auto const data) {
+    frames.emplace_back(tile, data);
+  }));
+  REQUIRE(frames.size() == 2);
+  CHECK(frames[0] == std::pair{geo::tile{1, 2, 3}, std::string{"abc"}});
+  CHECK(frames[1] == std::pair{geo::tile{0, 0, 0}, std::string{}});
+
+  CHECK_FALSE(for_each_tile_frame(std::string_view{buf}.substr(0, 18),
+                                  [](auto&&...) {}));
+}
@@ -0,0 +1,78 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/tile_cache.h"
+
+using namespace tiles;
+
+namespace {
+
+tile_cache::value_t make_value(size_t const size, char const c = 'x') {
+  return std::make_shared<std::string const>(size, c);
+}
+
+}  // namespace
+
+TEST_CASE("tile_cache get put") {
+  tile_cache cache{1024 * 1024, 4};
+
+  auto const k1 = tile_to_key(geo::tile{1, 2, 3});
+  auto const k2 = tile_to_key(geo::tile{2, 2, 3});
+
+  CHECK(cache.get(k1) == nullptr);
+
+  cache.put(k1, make_value(10, 'a'));
+  cache.put(k2, make_value(0));
+
+  auto const v1 = cache.get(k1);
+  REQUIRE(v1 != nullptr);
+  CHECK(*v1 == std::string(10, 'a'));
+
+  auto const v2 = cache.get(k2);
+  REQUIRE(v2 != nullptr);
+  CHECK(v2->empty());
+
+  cache.put(k1, make_value(5, 'b'));
+  auto const v3 = cache.get(k1);
+  REQUIRE(v3 != nullptr);
+  CHECK(*v3 == std::string(5, 'b'));
+  CHECK(*v1 == std::string(10, 'a'));  // old value still alive
+
+  auto const stats = cache.get_stats();
+  CHECK(stats.hits_ == 3);
+  CHECK(stats.misses_ == 1);
+  CHECK(stats.insertions_ == 3);
+  CHECK(stats.evictions_ == 0);
+  CHECK(stats.entries_ == 2);
+  CHECK(stats.size_ == 5 + 2 * tile_cache::kEntryOverhead);
+
+  cache.clear();
+  CHECK(cache.get(k1) == nullptr);
+  CHECK(cache.get_stats().entries_ == 0);
+}
+
+TEST_CASE("tile_cache lru eviction") {
+  auto constexpr kEntrySize = 1000 + tile_cache::kEntryOverhead;
+  tile_cache cache{3 * kEntrySize, 1};
+
+  auto const k = [](uint32_t x) { return tile_to_key(geo::tile{x, 0, 10}); };
+
+  cache.put(k(0), make_value(1000));
+  cache.put(k(1), make_value(1000));
+  cache.put(k(2), make_value(1000));
+  CHECK(cache.get(k(0)) != nullptr);  // k(1) is now least recently used
+
+  cache.put(k(3), make_value(1000));
+  CHECK(cache.get(k(1)) == nullptr);
+  CHECK(cache.get(k(0)) != nullptr);
+  CHECK(cache.get(k(2)) != nullptr);
+  CHECK(cache.get(k(3)) != nullptr);
+
+  auto const stats = cache.get_stats();
+  CHECK(stats.evictions_ == 1);
+  CHECK(stats.entries_ == 3);
+  CHECK(stats.size_ <= 3 * kEntrySize);
+
+  cache.put(k(4), make_value(4 * kEntrySize));  // larger than the shard
+  CHECK(cache.get(k(4)) == nullptr);
+  CHECK(cache.get_stats().entries_ == 3);
+}
@@ -0,0 +1,85 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/db/tile_etag.h"
+
+#include "test_tile_database.h"
+
+using namespace tiles;
+
+TEST_CASE("etag_hash") {
+  CHECK(etag_hash("") == kEtagHashSeed);
+  CHECK(etag_hash("a") == 0xaf63dc4c8601ec8cULL);  // FNV-1a reference
+  CHECK(etag_hash("ab") == etag_hash("b", etag_hash("a")));
+  CHECK(etag_hash("ab") != etag_hash("ba"));
+}
+
+TEST_CASE("etag_matches") {
+  CHECK(etag_matches("\"abc\"", "\"abc\""));
+  CHECK(etag_matches("W/\"abc\"", "\"abc\""));
+  CHECK(etag_matches("\"xyz\", \"abc\"", "\"abc\""));
+  CHECK(etag_matches("*", "\"abc\""));
+
+  CHECK_FALSE(etag_matches("", "\"abc\""));
+  CHECK_FALSE(etag_matches("\"abc-gz\"", "\"abc\""));
+  CHECK_FALSE(etag_matches("abc", "\"abc\""));
+}
+
+TEST_CASE("prepared_etag") {
+  test_tile_database db;
+  geo::tile const stored{1, 2, 3};
+  geo::tile const legacy{2, 2, 3};  // blob without etag record
+  geo::tile const missing{3, 2, 3};
+  {
+    auto txn = db.handle_.make_txn();
+    auto tiles_dbi = db.handle_.tiles_dbi(txn);
+    txn.put(tiles_dbi, tile_to_key(stored), "stored-blob");
+    put_prepared_etag(txn, tiles_dbi, stored, "stored-blob");
+    txn.put(tiles_dbi, tile_to_key(legacy), "legacy-blob");
+    txn.commit();
+  }
+
+  auto txn = db.handle_.make_txn();
+  auto tiles_dbi = db.handle_.tiles_dbi(txn);
+  CHECK(get_prepared_etag(txn, tiles_dbi, stored) == etag_hash("stored-blob"));
+  CHECK(get_prepared_etag(txn, tiles_dbi, legacy) == etag_hash("legacy-blob"));
+  CHECK(get_prepared_etag(txn, tiles_dbi, missing) == std::nullopt);
+}
+
+TEST_CASE("dynamic_etag") {
+  test_tile_database db;
+  geo::tile const tile{4, 5, 6};
+  auto const bounds = tile.bounds_on_z(kTileDefaultIndexZoomLvl);
+  auto const inside = tile_to_key(bounds.minx_, bounds.miny_,
+                                  kTileDefaultIndexZoomLvl);
+  auto const outside = tile_to_key(bounds.maxx_, bounds.miny_,
+                                   kTileDefaultIndexZoomLvl);
+
+  auto const put = [&](tile_key_t const key, std::string_view value) {
+    auto txn = db.handle_.make_txn();
+    auto features_dbi = db.handle_.features_dbi(txn);
+    txn.put(features_dbi, key, value);
+    txn.commit();
+  };
+  auto const get = [&](uint64_t const generation) {
+    auto txn = db.handle_.make_txn();
+    auto features_dbi = db.handle_.features_dbi(txn);
+    auto cursor = lmdb::cursor{txn, features_dbi};
+    return get_dynamic_etag(cursor, tile, generation);
+  };
+
+  auto const empty = get(1);  // nothing stored
+  CHECK(empty == get_generation_etag(tile, 1));
+  CHECK(get(2) != empty);
+
+  put(inside, "records-a");
+  auto const one = get(1);
+  CHECK(one != empty);
+  CHECK(get(1) == one);
+  CHECK(get(2) != one);
+
+  put(outside, "records-b");  // not in the tile
+  CHECK(get(1) == one);
+
+  put(inside, "records-c");
+  CHECK(get(1) != one);
+}
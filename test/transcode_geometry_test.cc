@@ -0,0 +1,88 @@
+#include "catch2/catch.hpp"
+
+#include <random>
+
+#include "tiles/constants.h"
+#include "tiles/fixed/algo/make_simplify_mask.h"
+#include "tiles/fixed/algo/shift.h"
+#include "tiles/fixed/io/deserialize.h"
+#include "tiles/fixed/io/serialize.h"
+#include "tiles/mvt/encode_geometry.h"
+#include "tiles/mvt/tile_spec.h"
+
+using namespace tiles;
+namespace pz = protozero;
+namespace ttm = tiles::tags::mvt;
+
+namespace {
+
+std::string encode(fixed_geometry const& geometry, tile_spec const& spec) {
+  std::string buf;
+  pz::pbf_builder<ttm::Feature> pb{buf};
+  encode_geometry(pb, geometry, spec);
+  return buf;
+}
+
+std::string transcode(std::string_view const geo,
+                      std::vector<std::string_view> const& masks,
+                      tile_spec const& spec) {
+  std::string buf;
+  pz::pbf_builder<ttm::Feature> pb{buf};
+  std::vector<uint32_t> scratch;
+  if (!transcode_geometry(pb, geo, masks, spec, scratch)) {
+    CHECK(buf.empty());
+  }
+  return buf;
+}
+
+}  // namespace
+
+TEST_CASE("transcode_geometry") {
+  geo::tile const tile{4, 5, 4};
+  tile_spec const spec{tile};
+  auto const& bounds = spec.insert_bounds_;
+  auto const size = bounds.max_corner().x() - bounds.min_corner().x();
+
+  std::mt19937 gen{42};  // NOLINT
+  auto const random_point = [&](fixed_coord_t const scale) {
+    std::uniform_int_distribution<fixed_coord_t> dist{0, scale};
+    return fixed_xy{bounds.min_corner().x() + size / 4 + dist(gen),
+                    bounds.min_corner().y() + size / 4 + dist(gen)};
+  };
+
+  for (auto i = 0; i < 200; ++i) {
+    // small scales: many points collapse when shifted to the tile zoom level
+    auto const scale = fixed_coord_t{1} << (4U + i % 20U);
+
+    fixed_point point;
+    fixed_polyline polyline;
+    polyline.resize(1 + i % 3);
+    for (auto j = 0; j < 1 + i % 7; ++j) {
+      point.push_back(random_point(scale));
+    }
+    for (auto& line : polyline) {
+      for (auto j = 0; j < 2 + i % 11; ++j) {
+        line.push_back(random_point(scale));
+      }
+    }
+
+    for (auto const& geometry :
+         {fixed_geometry{point}, fixed_geometry{polyline}}) {
+      auto const geo = serialize(geometry);
+      auto const masks = make_simplify_mask(geometry);
+      std::vector<std::string_view> const mask_views(std::begin(masks),
+                                                    std::end(masks));
+
+      for (auto z = tile.z_; z <= kMaxZoomLevel; z += 4) {
+        auto const child = geo::tile{tile.x_ << (z - tile.z_),
+                                     tile.y_ << (z - tile.z_), z};
+        tile_spec const child_spec{child};
+
+        CHECK(transcode(geo, {}, child_spec) ==
+              encode(shift(deserialize(geo), z), child_spec));
+        CHECK(transcode(geo, mask_views, child_spec) ==
+              encode(shift(deserialize(geo, mask_views, z), z), child_spec));
+      }
+    }
+  }
+}
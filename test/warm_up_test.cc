@@ -0,0 +1,77 @@
+#include "catch2/catch.hpp"
+
+#include <string>
+
+#include "tiles/db/warm_up.h"
+
+#include "test_tile_database.h"
+
+using namespace tiles;
+
+TEST_CASE("prefetch") {
+  CHECK(prefetch({}) == 0);
+
+  std::string const buf(3 * kWarmUpPageSize, '\0');
+  CHECK(prefetch(buf) == 0);
+  CHECK(prefetch(std::string_view{buf}.substr(100, 5000)) == 0);
+}
+
+TEST_CASE("warm_up_pack_queries") {
+  auto const queries = warm_up_pack_queries({{0, 0, 0},
+                                             {1, 1, 1},
+                                             {544, 355, 10},
+                                             {1090, 710, 11},
+                                             {8705, 5683, 14},
+                                             {0, 0, 0}});
+  CHECK(queries == std::vector<geo::tile>{
+                       {0, 0, 0}, {1, 1, 1}, {544, 355, 10}, {545, 355, 10}});
+}
+
+TEST_CASE("warm_up_packs") {
+  struct packs {
+    std::string_view get(pack_record r) const {
+      return std::string_view{buf_}.substr(r.offset_, r.size_);
+    }
+    std::string buf_ = std::string(100, 'x');
+  } const packs;
+
+  std::vector<geo::tile> queried;
+  auto const foreach_record = [&](geo::tile const& query, auto&& fn) {
+    queried.push_back(query);
+    fn(query, pack_record{0, 10});
+    fn(query, pack_record{10 * query.z_, 10});
+  };
+
+  warm_up_stats stats;
+  std::atomic_bool stop{false};
+  warm_up_packs(foreach_record, packs, {{1, 1, 1}, {4, 4, 3}, {9, 9, 4}},
+                stats, stop);
+  CHECK(queried.size() == 3);
+  CHECK(stats.packs_ == 4);  // offsets 0, 10, 30, 40
+  CHECK(stats.bytes_ == 40);
+
+  stop = true;
+  warm_up_packs(foreach_record, packs, {{1, 1, 1}}, stats, stop);
+  CHECK(queried.size() == 3);
+}
+
+TEST_CASE("warm_up_prepared") {
+  test_tile_database db;
+  {
+    auto txn = db.handle_.make_txn();
+    auto tiles_dbi = db.handle_.tiles_dbi(txn);
+    txn.put(tiles_dbi, tile_to_key({0, 0, 0}), std::string(10, 'a'));
+    txn.put(tiles_dbi, tile_to_key({0, 0, 0}, 1), std::string(8, 'e'));
+    txn.put(tiles_dbi, tile_to_key({1, 0, 1}), std::string(20, 'b'));
+    txn.put(tiles_dbi, tile_to_key({1, 0, 1}, 1), std::string(8, 'e'));
+    txn.put(tiles_dbi, tile_to_key({3, 3, 5}), std::string(40, 'c'));
+    txn.commit();
+  }
+
+  auto txn = db.handle_.make_txn();
+  warm_up_stats stats;
+  std::atomic_bool stop{false};
+  warm_up_prepared(txn, db.handle_.tiles_dbi(txn), 3, stats, stop);
+  CHECK(stats.tiles_ == 2);  // not the etags, not above max_z
+  CHECK(stats.bytes_ == 30);
+}